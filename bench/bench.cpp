@@ -0,0 +1,349 @@
+#include "synthetic.h"
+#include "../src/tuxdump.h"
+
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+
+#include <fmt/format.h>
+#include <rapidjson/prettywriter.h>
+#include <rapidjson/stringbuffer.h>
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/**
+ * Repeatable micro and macro benchmarks.  Results go to stdout as JSON,
+ * progress to stderr.
+ */
+class Bench {
+    public:
+        struct Result {
+            std::string name;
+            uint64_t iterations;
+            double nsPerOp;
+            double mbPerSec;
+        };
+    public:
+        Bench(const std::string& filter, double minTime) : m_filter(filter), m_minTime(minTime) {}
+        bool Wants(const std::string& name) const { return name.find(m_filter) != std::string::npos; }
+        void Run(const std::string& name, uint64_t bytesPerOp, const std::function<void()>& fn);
+        std::string ToJson() const;
+    private:
+        std::string m_filter;
+        double m_minTime;
+        std::vector<Result> m_results;
+};
+
+void Bench::Run(const std::string& name, uint64_t bytesPerOp, const std::function<void()>& fn)
+{
+    if (!Wants(name)) {
+        return;
+    }
+
+    // One warm-up round, then repeat until the minimum time is reached
+    fn();
+    uint64_t iterations = 0;
+    uint64_t start = Stats::Now();
+    uint64_t elapsed = 0;
+    do {
+        fn();
+        iterations++;
+        elapsed = Stats::Now() - start;
+    } while (elapsed < m_minTime * 1e9 || iterations < 3);
+
+    Result result;
+    result.name = name;
+    result.iterations = iterations;
+    result.nsPerOp = static_cast<double>(elapsed) / iterations;
+    result.mbPerSec = bytesPerOp ? bytesPerOp / result.nsPerOp * 1e9 / 1e6 : 0.0;
+    m_results.push_back(result);
+    fprintf(stderr, "%-48s %10llu it %14.0f ns/op %10.1f MB/s\n", name.c_str(),
+            static_cast<unsigned long long>(iterations), result.nsPerOp, result.mbPerSec);
+}
+
+std::string Bench::ToJson() const
+{
+    rapidjson::StringBuffer data;
+    rapidjson::PrettyWriter<rapidjson::StringBuffer> writer(data);
+    writer.StartObject();
+    writer.Key("benchmarks");
+    writer.StartArray();
+    for (const Result& result : m_results) {
+        writer.StartObject();
+        writer.Key("name");
+        writer.String(result.name.c_str());
+        writer.Key("iterations");
+        writer.Uint64(result.iterations);
+        writer.Key("ns_per_op");
+        writer.Double(result.nsPerOp);
+        writer.Key("mb_per_s");
+        writer.Double(result.mbPerSec);
+        writer.EndObject();
+    }
+    writer.EndArray();
+    writer.EndObject();
+    return data.GetString();
+}
+
+static std::vector<std::string> MakePatterns(size_t count, double wildcards, std::mt19937& rng)
+{
+    std::uniform_int_distribution<int> byte(0, 255);
+    std::uniform_real_distribution<double> chance(0.0, 1.0);
+    std::vector<std::string> patterns;
+    for (size_t i = 0; i < count; ++i) {
+        std::string pattern = fmt::format("{:02x}", byte(rng));
+        for (int j = 1; j < 16; ++j) {
+            pattern += chance(rng) < wildcards ? "?" : fmt::format("{:02x}", byte(rng));
+        }
+        patterns.push_back(pattern);
+    }
+    return patterns;
+}
+
+static void BenchScan(Bench& bench, size_t size)
+{
+    static const double densities[] = {0.0, 0.25, 0.5};
+    static const size_t counts[] = {1, 16, 64};
+    std::mt19937 rng(1);
+
+    for (int kind = 0; kind < 2; ++kind) {
+        const char* kindName = kind ? "x86" : "random";
+        SyntheticSource mem;
+        uint8_t* data = mem.AddRegion(0x400000, size, PROT_READ | PROT_EXEC, "/bench/scan.so");
+        if (kind) {
+            FillCode(data, size, rng);
+        } else {
+            std::uniform_int_distribution<int> byte(0, 255);
+            for (size_t i = 0; i < size; ++i) {
+                data[i] = byte(rng);
+            }
+        }
+
+        Scanner scanner(mem);
+        for (double density : densities) {
+            for (size_t count : counts) {
+                std::vector<std::string> patterns = MakePatterns(count, density, rng);
+                std::string name = fmt::format("scan/{}/patterns={}/wildcards={}", kindName, count, density);
+                bench.Run(name, size * count, [&]() {
+                    for (const std::string& pattern : patterns) {
+                        scanner.FindPattern("scan.so", pattern.c_str(), 0);
+                    }
+                });
+            }
+        }
+    }
+}
+
+static void BenchXrefs(Bench& bench, size_t size)
+{
+    std::mt19937 rng(1);
+    SyntheticSource mem;
+    uint8_t* data = mem.AddRegion(0x400000, size, PROT_READ | PROT_EXEC, "/bench/xrefs.so");
+    FillCode(data, size, rng);
+    const Region* module = mem.GetRegion("xrefs.so");
+
+    size_t threads[] = {1, 0};
+    for (size_t count : threads) {
+        ThreadPool pool(count);
+        if (!count && pool.GetSize() == 1) {
+            continue;
+        }
+        std::string name = fmt::format("xrefs/x86/threads={}", pool.GetSize());
+        bench.Run(name, size, [&]() {
+            XrefIndex xrefs;
+            xrefs.Build(mem, module, data, pool);
+        });
+    }
+}
+
+static void BenchNetvars(Bench& bench)
+{
+    static const size_t sizes[] = {1000, 10000};
+    for (size_t classes : sizes) {
+        std::string name = fmt::format("netvars/classes={}", classes);
+        if (!bench.Wants(name)) {
+            continue;
+        }
+
+        SyntheticOptions opts;
+        opts.classes = classes;
+        opts.codeSize = 1 << 20;
+        opts.patterns = 0;
+
+        SyntheticSource mem;
+        uintptr_t graphBase = 0x10000000;
+        size_t graphSize = GetClassGraphSize(opts);
+        SyntheticArena arena(mem.AddRegion(graphBase, graphSize, PROT_READ | PROT_WRITE, ""),
+                graphBase, graphSize);
+        uintptr_t head = BuildClassGraph(arena, opts);
+
+        uintptr_t moduleBase = 0x7f0000000000;
+        std::vector<SyntheticSignature> signatures;
+        uint8_t* module = mem.AddRegion(moduleBase, GetModuleSize(opts), PROT_READ | PROT_EXEC,
+                "/bench/client_client.so");
+        BuildModule(module, moduleBase, opts, head, signatures);
+        Context ctx;
+        ctx.SetMemory(&mem);
+        if (!ctx.LoadConfigString(BuildConfig("client_client.so", signatures))) {
+            continue;
+        }
+
+        bench.Run(name, arena.Used(), [&]() {
+            Tools::ScanNetvars(ctx);
+        });
+    }
+}
+
+static void BenchFormatter(Bench& bench)
+{
+    static const char* formats[] = {"cpp", "java"};
+
+    // 1000 tables of 100 offsets each
+    rapidjson::StringBuffer data;
+    rapidjson::PrettyWriter<rapidjson::StringBuffer> writer(data);
+    writer.StartObject();
+    for (int table = 0; table < 1000; ++table) {
+        writer.Key(fmt::format("DT_Table{}", table).c_str());
+        writer.StartObject();
+        for (int entry = 0; entry < 100; ++entry) {
+            writer.Key(fmt::format("m_nEntry[{}]", entry).c_str());
+            writer.Uint(entry * 4);
+        }
+        writer.EndObject();
+    }
+    writer.EndObject();
+    std::string json = data.GetString();
+
+    for (const char* format : formats) {
+        std::string name = fmt::format("formatter/{}/entries=100000", format);
+        if (!bench.Wants(name)) {
+            continue;
+        }
+        Formatter formatter;
+        if (!formatter.LoadFormat(format)) {
+            fprintf(stderr, "skipping %s: formats.cfg not found\n", name.c_str());
+            continue;
+        }
+
+        fflush(stdout);
+        int saved = dup(STDOUT_FILENO);
+        int null = open("/dev/null", O_WRONLY);
+        dup2(null, STDOUT_FILENO);
+        bench.Run(name, json.size(), [&]() {
+            formatter.Print(json, "netvars");
+        });
+        fflush(stdout);
+        dup2(saved, STDOUT_FILENO);
+        close(null);
+        close(saved);
+    }
+}
+
+static void BenchEndToEnd(Bench& bench, size_t classes)
+{
+    std::string name = fmt::format("end-to-end/classes={}", classes);
+    if (!bench.Wants(name)) {
+        return;
+    }
+
+    int fds[2];
+    if (pipe(fds) == -1) {
+        perror("pipe");
+        return;
+    }
+
+    pid_t child = fork();
+    if (child == 0) {
+        // The target: build everything, hand over the config and wait
+        close(fds[0]);
+        SyntheticOptions opts;
+        opts.classes = classes;
+        SyntheticTarget target;
+        bool bOk = CreateTarget(opts, "client_client.so", target);
+        if (bOk && write(fds[1], target.config.data(), target.config.size()) < 0) {
+            bOk = false;
+        }
+        close(fds[1]);
+        if (bOk) {
+            sigset_t set;
+            sigemptyset(&set);
+            sigaddset(&set, SIGTERM);
+            sigprocmask(SIG_BLOCK, &set, nullptr);
+            int sig;
+            sigwait(&set, &sig);
+        }
+        DestroyTarget(target);
+        _exit(0);
+    }
+    close(fds[1]);
+
+    std::string config;
+    char buffer[4096];
+    ssize_t received;
+    while ((received = read(fds[0], buffer, sizeof(buffer))) > 0) {
+        config.append(buffer, received);
+    }
+    close(fds[0]);
+
+    if (!config.empty()) {
+        Context ctx;
+        if (ctx.LoadConfigString(config)) {
+            bench.Run(name, 0, [&]() {
+                ProcessSource process;
+                ctx.SetMemory(&process);
+                if (process.Attach(child) && process.ParseMaps()) {
+                    Tools::ScanSignatures(ctx);
+                    Tools::ScanNetvars(ctx);
+                }
+            });
+        }
+    }
+
+    kill(child, SIGTERM);
+    waitpid(child, nullptr, 0);
+}
+
+int main(int argc, char* argv[])
+{
+    std::string filter;
+    double minTime = 0.5;
+    size_t scanSize = 32 << 20;
+    size_t classes = 10000;
+
+    static const option longOptions[] = {
+        {"filter", required_argument, nullptr, 'f'},
+        {"min-time", required_argument, nullptr, 't'},
+        {"scan-size", required_argument, nullptr, 's'},
+        {"classes", required_argument, nullptr, 'c'},
+        {nullptr, 0, nullptr, 0}
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, "", longOptions, nullptr)) != -1) {
+        switch (c) {
+            case 'f': filter = optarg; break;
+            case 't': minTime = strtod(optarg, nullptr); break;
+            case 's': scanSize = strtoul(optarg, nullptr, 0); break;
+            case 'c': classes = strtoul(optarg, nullptr, 0); break;
+            default:
+                fprintf(stderr, "Usage: %s [--filter=substring] [--min-time=seconds]"
+                        " [--scan-size=bytes] [--classes=n]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    Bench bench(filter, minTime);
+    BenchScan(bench, scanSize);
+    BenchXrefs(bench, scanSize);
+    BenchNetvars(bench);
+    BenchFormatter(bench);
+    BenchEndToEnd(bench, classes);
+    puts(bench.ToJson().c_str());
+    return 0;
+}
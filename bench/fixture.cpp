@@ -0,0 +1,117 @@
+#include "synthetic.h"
+
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <getopt.h>
+#include <sys/prctl.h>
+#include <unistd.h>
+
+/**
+ * A stand-in for the game: builds a ClientClass graph and a code-like
+ * module full of signatures in its own memory, then waits to be dumped.
+ */
+
+static volatile sig_atomic_t s_bStop = 0;
+
+static void StopHandler(int)
+{
+    s_bStop = 1;
+}
+
+static void PrintUsage(const char* argv0)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "    --name=[process]    process name to register (default tuxdump_target)\n"
+            "    --module=[name]     module holding the signatures (default client_client.so)\n"
+            "    --config=[file]     where to write the matching signature config (default fixture.cfg)\n"
+            "    --classes=[n]       number of ClientClasses (default 1000)\n"
+            "    --depth=[n]         nested data tables per class (default 2)\n"
+            "    --props=[n]         props per table (default 16)\n"
+            "    --patterns=[n]      number of planted signatures (default 64)\n"
+            "    --code-size=[bytes] size of the code region (default 16 MiB)\n"
+            "    --wildcards=[0-1]   wildcard density of the patterns (default 0.2)\n"
+            "    --seed=[n]          random seed (default 1)\n", argv0);
+}
+
+int main(int argc, char* argv[])
+{
+    SyntheticOptions opts;
+    std::string name = "tuxdump_target";
+    std::string module = "client_client.so";
+    std::string config = "fixture.cfg";
+
+    static const option longOptions[] = {
+        {"name", required_argument, nullptr, 'n'},
+        {"module", required_argument, nullptr, 'm'},
+        {"config", required_argument, nullptr, 'c'},
+        {"classes", required_argument, nullptr, 'C'},
+        {"depth", required_argument, nullptr, 'd'},
+        {"props", required_argument, nullptr, 'p'},
+        {"patterns", required_argument, nullptr, 'P'},
+        {"code-size", required_argument, nullptr, 's'},
+        {"wildcards", required_argument, nullptr, 'w'},
+        {"seed", required_argument, nullptr, 'S'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0}
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, "h", longOptions, nullptr)) != -1) {
+        switch (c) {
+            case 'n': name = optarg; break;
+            case 'm': module = optarg; break;
+            case 'c': config = optarg; break;
+            case 'C': opts.classes = strtoul(optarg, nullptr, 0); break;
+            case 'd': opts.depth = strtoul(optarg, nullptr, 0); break;
+            case 'p': opts.props = strtoul(optarg, nullptr, 0); break;
+            case 'P': opts.patterns = strtoul(optarg, nullptr, 0); break;
+            case 's': opts.codeSize = strtoul(optarg, nullptr, 0); break;
+            case 'w': opts.wildcards = strtod(optarg, nullptr); break;
+            case 'S': opts.seed = strtoul(optarg, nullptr, 0); break;
+            default:
+                PrintUsage(argv[0]);
+                return c == 'h' ? 0 : 1;
+        }
+    }
+
+    if (opts.props == 0 || opts.props > 1024) {
+        fprintf(stderr, "--props must be between 1 and 1024\n");
+        return 1;
+    }
+
+    SyntheticTarget target;
+    if (!CreateTarget(opts, module, target)) {
+        DestroyTarget(target);
+        return 1;
+    }
+
+    FILE* out = fopen(config.c_str(), "w");
+    if (!out) {
+        perror(config.c_str());
+        DestroyTarget(target);
+        return 1;
+    }
+    fputs(target.config.c_str(), out);
+    fclose(out);
+
+    prctl(PR_SET_NAME, name.c_str());
+    signal(SIGINT, StopHandler);
+    signal(SIGTERM, StopHandler);
+
+    printf("pid %d name %s module %s config %s classes %zu graph %zu bytes\n",
+            getpid(), name.substr(0, 15).c_str(), target.path.c_str(), config.c_str(),
+            opts.classes, target.graphSize);
+    fflush(stdout);
+
+    while (!s_bStop) {
+        pause();
+    }
+
+    DestroyTarget(target);
+    return 0;
+}
@@ -0,0 +1,372 @@
+#include "synthetic.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#include <fmt/format.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Same layout as the LP64 Source SDK structures walked by netvars.cpp
+struct SynClientClass {
+    uint64_t createFn;
+    uint64_t createEventFn;
+    uint64_t networkName;
+    uint64_t recvTable;
+    uint64_t next;
+    int32_t classId;
+};
+
+struct SynRecvProp {
+    uint64_t varName;
+    int32_t recvType;
+    int32_t flags;
+    int32_t stringBufferSize;
+    uint8_t insideArray;
+    uint8_t pad0[3];
+    uint64_t extraData;
+    uint64_t arrayProp;
+    uint64_t arrayLengthProxy;
+    uint64_t proxyFn;
+    uint64_t dataTableProxyFn;
+    uint64_t dataTable;
+    uint32_t offset;
+    int32_t elementStride;
+    uint32_t elements;
+    uint8_t pad1[4];
+    uint64_t parentArrayPropName;
+};
+
+struct SynRecvTable {
+    uint64_t props;
+    uint32_t propCount;
+    uint8_t pad0[4];
+    uint64_t decoder;
+    uint64_t netTableName;
+    uint8_t initialized;
+};
+
+static_assert(sizeof(SynClientClass) == 48, "ClientClass layout");
+static_assert(sizeof(SynRecvProp) == 96, "RecvProp layout");
+static_assert(sizeof(SynRecvTable) == 40, "RecvTable layout");
+
+static constexpr int DPT_Int = 0;
+static constexpr int DPT_DataTable = 6;
+static constexpr size_t PAGE = 4096;
+static constexpr size_t NAME_SIZE = 64;
+
+uintptr_t SyntheticArena::Alloc(size_t size, size_t align)
+{
+    size_t offset = (m_used + align - 1) & ~(align - 1);
+    if (offset + size > m_capacity) {
+        throw std::length_error("synthetic arena exhausted");
+    }
+    m_used = offset + size;
+    memset(m_data + offset, 0, size);
+    return m_base + offset;
+}
+
+uintptr_t SyntheticArena::String(const std::string& text)
+{
+    uintptr_t address = Alloc(text.size() + 1, 1);
+    memcpy(At<char>(address), text.c_str(), text.size() + 1);
+    return address;
+}
+
+size_t GetClassGraphSize(const SyntheticOptions& opts)
+{
+    size_t table = 48 + opts.props * sizeof(SynRecvProp) + 16 + 32;
+    size_t perClass = sizeof(SynClientClass) + 16 + 32 + (opts.depth + 1) * table;
+    // Names are read NAME_SIZE bytes at a time, keep the tail readable
+    return opts.classes * perClass + opts.props * 16 + 64 + NAME_SIZE + PAGE;
+}
+
+static uintptr_t BuildTable(SyntheticArena& arena, const std::string& name,
+        const std::vector<uintptr_t>& propNames, uintptr_t subName, uintptr_t subTable)
+{
+    size_t count = propNames.size();
+    uintptr_t tableAddr = arena.Alloc(sizeof(SynRecvTable));
+    uintptr_t propsAddr = arena.Alloc(count * sizeof(SynRecvProp));
+
+    SynRecvProp* props = arena.At<SynRecvProp>(propsAddr);
+    for (size_t i = 0; i < count; ++i) {
+        props[i].varName = propNames[i];
+        props[i].recvType = DPT_Int;
+        props[i].offset = 0x10 + i * 4;
+    }
+    if (subTable && count > 0) {
+        SynRecvProp& sub = props[count - 1];
+        sub.varName = subName;
+        sub.recvType = DPT_DataTable;
+        sub.dataTable = subTable;
+        sub.offset = 0x10 + count * 4;
+    }
+
+    SynRecvTable* table = arena.At<SynRecvTable>(tableAddr);
+    table->props = propsAddr;
+    table->propCount = count;
+    table->netTableName = arena.String(name);
+    table->initialized = 1;
+    return tableAddr;
+}
+
+uintptr_t BuildClassGraph(SyntheticArena& arena, const SyntheticOptions& opts)
+{
+    std::vector<uintptr_t> propNames;
+    for (size_t i = 0; i < opts.props; ++i) {
+        propNames.push_back(arena.String(fmt::format("m_nProp{}", i)));
+    }
+    uintptr_t subName = arena.String("m_Sub");
+
+    uintptr_t head = 0;
+    SynClientClass* previous = nullptr;
+    for (size_t c = 0; c < opts.classes; ++c) {
+        uintptr_t table = 0;
+        for (size_t d = opts.depth + 1; d-- > 0;) {
+            std::string name = d ? fmt::format("DT_Class{}_Sub{}", c, d) : fmt::format("DT_Class{}", c);
+            table = BuildTable(arena, name, propNames, subName, table);
+        }
+
+        uintptr_t address = arena.Alloc(sizeof(SynClientClass));
+        SynClientClass* cc = arena.At<SynClientClass>(address);
+        cc->networkName = arena.String(fmt::format("CClass{}", c));
+        cc->recvTable = table;
+        cc->classId = c;
+        if (previous) {
+            previous->next = address;
+        } else {
+            head = address;
+        }
+        previous = arena.At<SynClientClass>(address);
+    }
+    arena.Alloc(NAME_SIZE, 1);
+    return head;
+}
+
+size_t GetModuleSize(const SyntheticOptions& opts)
+{
+    return ((opts.codeSize + PAGE - 1) & ~(PAGE - 1)) + PAGE;
+}
+
+void FillCode(uint8_t* data, size_t size, std::mt19937& rng)
+{
+    // A handful of common x86-64 encodings, so byte frequencies look like code
+    static const std::vector<std::vector<uint8_t>> snippets = {
+        {0x55}, {0x48, 0x89, 0xe5}, {0x5d}, {0xc3}, {0x90},
+        {0x48, 0x8b, 0x05}, {0x48, 0x8d, 0x3d}, {0xe8}, {0xe9},
+        {0x48, 0x83, 0xec}, {0x48, 0x83, 0xc4}, {0x89, 0xc7}, {0x31, 0xc0},
+        {0x0f, 0x1f, 0x44, 0x00, 0x00}, {0x41, 0x54}, {0x41, 0x5c}, {0x74}, {0x75},
+        {0x48, 0x85, 0xc0}, {0x8b, 0x47}, {0x89, 0x47}, {0xf3, 0x0f, 0x10}
+    };
+    std::uniform_int_distribution<size_t> pick(0, snippets.size() - 1);
+    std::uniform_int_distribution<int> operand(0, 4);
+    std::uniform_int_distribution<int> byte(0, 255);
+
+    size_t pos = 0;
+    while (pos < size) {
+        const std::vector<uint8_t>& snippet = snippets[pick(rng)];
+        for (size_t i = 0; i < snippet.size() && pos < size; ++i) {
+            data[pos++] = snippet[i];
+        }
+        for (int i = operand(rng); i > 0 && pos < size; --i) {
+            data[pos++] = byte(rng);
+        }
+    }
+}
+
+static std::string PlantTail(uint8_t* at, size_t length, double wildcards, std::mt19937& rng)
+{
+    std::uniform_int_distribution<int> byte(0, 255);
+    std::uniform_real_distribution<double> chance(0.0, 1.0);
+    std::string pattern;
+    for (size_t i = 0; i < length; ++i) {
+        at[i] = byte(rng);
+        // Keep the first tail bytes fixed so each pattern stays unique
+        if (i >= 8 && chance(rng) < wildcards) {
+            pattern += "?";
+        } else {
+            pattern += fmt::format("{:02x}", at[i]);
+        }
+    }
+    return pattern;
+}
+
+void BuildModule(uint8_t* data, uintptr_t base, const SyntheticOptions& opts, uintptr_t classHead,
+        std::vector<SyntheticSignature>& signatures)
+{
+    std::mt19937 rng(opts.seed);
+    size_t codeSize = GetModuleSize(opts) - PAGE;
+    FillCode(data, codeSize, rng);
+
+    // dwGetAllClasses: mov rax, [rip+slot]; slot -> pointer -> class head,
+    // printed relative to the module like every relative entry
+    uintptr_t slot = codeSize;
+    size_t count = opts.patterns + 1;
+    size_t spacing = codeSize / (count + 1);
+    std::uniform_int_distribution<size_t> module(0, GetModuleSize(opts) - 8);
+    std::uniform_int_distribution<int> imm(0x10, 0xffff);
+    std::uniform_int_distribution<size_t> tailLength(12, 24);
+    size_t strings = slot + 16;
+
+    for (size_t i = 0; i < count; ++i) {
+        size_t at = (i + 1) * spacing;
+        // int3 padding like between functions, so a linear sweep is in sync
+        memset(data + at - 16, 0xcc, 16);
+        SyntheticSignature sig;
+        sig.offset = 2;
+        sig.relative = true;
+        if (i == 0) {
+            sig.name = "dwGetAllClasses";
+            data[at] = 0x48;
+            data[at + 1] = 0x8b;
+            data[at + 2] = 0x05;
+            int32_t disp = static_cast<int32_t>(slot - (at + 7));
+            memcpy(data + at + 3, &disp, sizeof(disp));
+            sig.pattern = "488b05????";
+            sig.expected = classHead - base;
+            uint64_t pointers[2] = {base + slot + 8, classHead};
+            memcpy(data + slot, pointers, sizeof(pointers));
+        } else if (i % 2) {
+            // lea rax, [rip+target]
+            sig.name = fmt::format("dwRelative{}", i);
+            size_t target = module(rng);
+            data[at] = 0x48;
+            data[at + 1] = 0x8d;
+            data[at + 2] = 0x05;
+            int32_t disp = static_cast<int32_t>(target - (at + 7));
+            memcpy(data + at + 3, &disp, sizeof(disp));
+            sig.pattern = "488d05????";
+            sig.expected = target;
+        } else {
+            // mov eax, [rax+imm32]
+            sig.name = fmt::format("dwOffset{}", i);
+            int32_t value = imm(rng);
+            data[at] = 0x8b;
+            data[at + 1] = 0x80;
+            memcpy(data + at + 2, &value, sizeof(value));
+            data[at + 6] = 0x90;
+            sig.pattern = "8b80????90";
+            sig.relative = false;
+            sig.expected = value;
+        }
+        sig.pattern += PlantTail(data + at + 7, tailLength(rng), opts.wildcards, rng);
+        signatures.push_back(sig);
+
+        if (i % 2) {
+            // lea rdi, [rip+string]; mov rax, [rip+target] halfway to the next site
+            SyntheticSignature anchored;
+            anchored.name = fmt::format("dwString{}", i);
+            anchored.text = fmt::format("Synthetic{}", i);
+            anchored.offset = 9;
+            anchored.expected = sig.expected;
+            size_t string = strings;
+            memcpy(data + string, anchored.text.c_str(), anchored.text.size() + 1);
+            strings += anchored.text.size() + 1;
+
+            size_t code = at + spacing / 2;
+            memset(data + code - 16, 0xcc, 16);
+            const uint8_t opcodes[2][3] = {{0x48, 0x8d, 0x3d}, {0x48, 0x8b, 0x05}};
+            size_t targets[2] = {string, sig.expected};
+            for (int j = 0; j < 2; ++j) {
+                memcpy(data + code + j * 7, opcodes[j], 3);
+                int32_t disp = static_cast<int32_t>(targets[j] - (code + j * 7 + 7));
+                memcpy(data + code + j * 7 + 3, &disp, sizeof(disp));
+            }
+            signatures.push_back(anchored);
+
+            SyntheticSignature field;
+            field.name = sig.name + "_Field";
+            field.base = sig.name;
+            field.extra = 0x10;
+            field.expected = sig.expected + field.extra;
+            signatures.push_back(field);
+        }
+    }
+}
+
+std::string BuildConfig(const std::string& module, const std::vector<SyntheticSignature>& signatures)
+{
+    std::string cfg = "signatures: {\n";
+    for (const SyntheticSignature& sig : signatures) {
+        bool bClasses = sig.name == "dwGetAllClasses";
+        cfg += fmt::format("    {}: {{\n", sig.name);
+        if (!sig.base.empty()) {
+            cfg += fmt::format("        base = \"{}\"\n", sig.base);
+            cfg += fmt::format("        comment = \"expect {:#x}\"\n", sig.expected);
+            cfg += fmt::format("        extra = {}\n", sig.extra);
+            cfg += "    }\n\n";
+            continue;
+        }
+        cfg += fmt::format("        region = \"{}\"\n", module);
+        if (!sig.text.empty()) {
+            cfg += fmt::format("        string = \"{}\"\n", sig.text);
+        } else {
+            cfg += fmt::format("        pattern = \"{}\"\n", sig.pattern);
+        }
+        cfg += fmt::format("        comment = \"expect {:#x}\"\n", sig.expected);
+        cfg += fmt::format("        offset = [{}]\n", bClasses ? "2, 0, 0" : std::to_string(sig.offset));
+        cfg += "        extra = 0\n";
+        cfg += fmt::format("        relative = {}\n", sig.relative ? 1 : 0);
+        cfg += "    }\n\n";
+    }
+    cfg += "}\n";
+    return cfg;
+}
+
+bool CreateTarget(const SyntheticOptions& opts, const std::string& module, SyntheticTarget& target)
+{
+    target.graphSize = GetClassGraphSize(opts);
+    void* graph = mmap(nullptr, target.graphSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (graph == MAP_FAILED) {
+        perror("mmap");
+        return false;
+    }
+    SyntheticArena arena(static_cast<uint8_t*>(graph), reinterpret_cast<uintptr_t>(graph), target.graphSize);
+    uintptr_t head = BuildClassGraph(arena, opts);
+
+    char dir[] = "/tmp/tuxdump-fixture.XXXXXX";
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return false;
+    }
+    target.dir = dir;
+    target.path = target.dir + "/" + module;
+
+    size_t moduleSize = GetModuleSize(opts);
+    int fd = open(target.path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1 || ftruncate(fd, moduleSize) == -1) {
+        perror(target.path.c_str());
+        if (fd != -1) {
+            close(fd);
+        }
+        return false;
+    }
+    void* mapped = mmap(nullptr, moduleSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        perror("mmap");
+        return false;
+    }
+
+    uint8_t* data = static_cast<uint8_t*>(mapped);
+    BuildModule(data, reinterpret_cast<uintptr_t>(mapped), opts, head, target.signatures);
+    mprotect(data, moduleSize - PAGE, PROT_READ | PROT_EXEC);
+    mprotect(data + moduleSize - PAGE, PAGE, PROT_READ);
+
+    target.config = BuildConfig(module, target.signatures);
+    return true;
+}
+
+void DestroyTarget(SyntheticTarget& target)
+{
+    if (!target.path.empty()) {
+        unlink(target.path.c_str());
+    }
+    if (!target.dir.empty()) {
+        rmdir(target.dir.c_str());
+    }
+}
@@ -0,0 +1,85 @@
+#ifndef  __TUXDUMP_BENCH_SYNTHETIC_H__
+#define  __TUXDUMP_BENCH_SYNTHETIC_H__
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+/**
+ * Shape of a synthetic Source-engine target.  Every class gets a RecvTable
+ * with `props` properties and a chain of `depth` nested data tables.
+ */
+struct SyntheticOptions {
+    size_t classes = 1000;
+    size_t depth = 2;
+    size_t props = 16;
+    size_t patterns = 64;
+    size_t codeSize = 16 << 20;
+    double wildcards = 0.2;
+    uint32_t seed = 1;
+};
+
+/**
+ * A planted signature.  Entries with a base are derived: they add extra to
+ * the value of the named entry instead of scanning.  Entries with text are
+ * anchored on the code that loads that string.
+ */
+struct SyntheticSignature {
+    std::string name;
+    std::string pattern;
+    std::string base;
+    std::string text;
+    int offset = 0;
+    int extra = 0;
+    bool relative = true;
+    uint64_t expected = 0;
+};
+
+/**
+ * Bump allocator over a caller provided buffer.  Addresses handed out are
+ * base + offset, so the graph can live at its real address (fixture) or at
+ * any address inside a SyntheticSource (benchmarks).
+ */
+class SyntheticArena {
+    public:
+        SyntheticArena(uint8_t* data, uintptr_t base, size_t capacity)
+            : m_data(data), m_base(base), m_capacity(capacity) {}
+        uintptr_t Alloc(size_t size, size_t align = 16);
+        uintptr_t String(const std::string& text);
+        template<typename T>
+        T* At(uintptr_t address) { return reinterpret_cast<T*>(m_data + (address - m_base)); }
+        size_t Used() const { return m_used; }
+    private:
+        uint8_t* m_data;
+        uintptr_t m_base;
+        size_t m_capacity;
+        size_t m_used = 0;
+};
+
+size_t GetClassGraphSize(const SyntheticOptions& opts);
+uintptr_t BuildClassGraph(SyntheticArena& arena, const SyntheticOptions& opts);
+
+size_t GetModuleSize(const SyntheticOptions& opts);
+void FillCode(uint8_t* data, size_t size, std::mt19937& rng);
+void BuildModule(uint8_t* data, uintptr_t base, const SyntheticOptions& opts, uintptr_t classHead,
+        std::vector<SyntheticSignature>& signatures);
+std::string BuildConfig(const std::string& module, const std::vector<SyntheticSignature>& signatures);
+
+/**
+ * A complete target inside the calling process: the class graph on an
+ * anonymous mapping and the module as a private mapping of a temporary
+ * file, so it can be found by name in /proc/<pid>/maps.
+ */
+struct SyntheticTarget {
+    std::string dir;
+    std::string path;
+    std::string config;
+    size_t graphSize;
+    std::vector<SyntheticSignature> signatures;
+};
+
+bool CreateTarget(const SyntheticOptions& opts, const std::string& module, SyntheticTarget& target);
+void DestroyTarget(SyntheticTarget& target);
+
+#endif //__TUXDUMP_BENCH_SYNTHETIC_H__
@@ -0,0 +1,97 @@
+#include "context.h"
+#include "logger.h"
+
+#include <cstring>
+
+bool Context::LoadConfig(const char* path)
+{
+    ScopedPhase phase(&m_stats, "ReadSignatureConfig", path);
+    try {
+        m_cfg.readFile(path);
+    } catch (const libconfig::FileIOException& fioex) {
+        return false;
+    } catch (const libconfig::ParseException& pex) {
+        Logger::Error("Parse exception: {}\nFile: {}:{}\n", 
+                pex.getError(), path, pex.getLine());
+        return false;
+    }
+    return ValidateConfig();
+}
+
+bool Context::LoadConfigString(const std::string& text)
+{
+    try {
+        m_cfg.readString(text);
+    } catch (const libconfig::ParseException& pex) {
+        Logger::Error("Parse exception: {}\nLine: {}\n", pex.getError(), pex.getLine());
+        return false;
+    }
+    return ValidateConfig();
+}
+
+bool Context::ValidateConfig()
+{
+    try {
+        libconfig::Setting& signatures = m_cfg.lookup("signatures");
+        for (libconfig::Setting& entry : signatures) {
+            // Derived entries only name the entry they build on
+            if (entry.exists("base")) {
+                const char* base = entry.lookup("base");
+                if (!signatures.exists(base)) {
+                    Logger::Error("{}: unknown base \"{}\"", entry.getPath(), base);
+                    return false;
+                }
+                continue;
+            }
+            // Xref and string entries match the code referencing another
+            // entry or a string, symbol entries may need no scan at all
+            if (entry.exists("xref")) {
+                const char* xref = entry.lookup("xref");
+                if (!signatures.exists(xref)) {
+                    Logger::Error("{}: unknown xref \"{}\"", entry.getPath(), xref);
+                    return false;
+                }
+            } else if (!entry.exists("string") && !entry.exists("symbol")) {
+                entry.lookup("pattern");
+            }
+            const char* operand;
+            if (entry.lookupValue("operand", operand) && strcmp(operand, "disp") && strcmp(operand, "imm")) {
+                Logger::Error("{}: operand must be \"disp\" or \"imm\"", entry.getPath());
+                return false;
+            }
+            entry.lookup("region");
+            entry.lookup("offset");
+            entry.lookup("extra");
+            entry.lookup("relative");
+        }
+        signatures.lookup("dwGetAllClasses");
+        signatures.lookup("dwGetAllClasses.offset");
+        signatures.lookup("dwGetAllClasses.pattern");
+    } catch (const libconfig::SettingNotFoundException& snfex) {
+        Logger::Error("{}: {}", snfex.what(), snfex.getPath());
+        return false;
+    }
+    return true;
+}
+
+void Context::SetMemory(MemorySource* mem)
+{
+    m_mem = mem;
+    if (m_mem) {
+        m_mem->SetStats(&m_stats);
+    }
+}
+
+void Context::SetThreads(size_t threads)
+{
+    m_threads = threads;
+    m_pool.reset();
+}
+
+ThreadPool& Context::GetPool()
+{
+    if (!m_pool) {
+        m_pool.reset(new ThreadPool(m_threads));
+    }
+    return *m_pool;
+}
@@ -0,0 +1,45 @@
+#ifndef  __TUXDUMP_CONTEXT_H__
+#define  __TUXDUMP_CONTEXT_H__
+#include "filter.h"
+#include "hints.h"
+#include "memory/source.h"
+#include "stats.h"
+#include "threadpool.h"
+
+#include <memory>
+#include <string>
+
+#include <libconfig.h++>
+
+/**
+ * Everything a dump needs: the memory to read, the signature config, the
+ * names to dump, hints from earlier runs, the run statistics and the
+ * worker threads.  Independent contexts can be used
+ * side by side.
+ */
+class Context {
+    public:
+        bool LoadConfig(const char* path);
+        bool LoadConfigString(const std::string& text);
+        void SetMemory(MemorySource* mem);
+        void SetThreads(size_t threads);
+
+        MemorySource& GetMemory() { return *m_mem; }
+        libconfig::Config& GetConfig() { return m_cfg; }
+        Stats& GetStats() { return m_stats; }
+        NameFilter& GetFilter() { return m_filter; }
+        Hints& GetHints() { return m_hints; }
+        ThreadPool& GetPool();
+    private:
+        bool ValidateConfig();
+    private:
+        MemorySource* m_mem = nullptr;
+        libconfig::Config m_cfg;
+        Stats m_stats;
+        NameFilter m_filter;
+        Hints m_hints;
+        size_t m_threads = 0;
+        std::unique_ptr<ThreadPool> m_pool;
+};
+
+#endif //__TUXDUMP_CONTEXT_H__
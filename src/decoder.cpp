@@ -0,0 +1,243 @@
+#include "decoder.h"
+
+#include <cstring>
+
+enum {
+    F_MODRM = 1,
+    F_IMM8 = 2,
+    F_IMMZ = 4,
+    F_IMM16 = 8,
+    F_REL = 16,
+    F_INVALID = 32,
+    F_SPECIAL = 64,
+    F_PREFIX = 128
+};
+
+static const uint8_t M = F_MODRM;
+static const uint8_t I8 = F_IMM8;
+static const uint8_t I16 = F_IMM16;
+static const uint8_t IZ = F_IMMZ;
+static const uint8_t X = F_INVALID;
+static const uint8_t S = F_SPECIAL;
+static const uint8_t P = F_PREFIX;
+static const uint8_t MS = F_MODRM | F_SPECIAL;
+static const uint8_t MI8 = F_MODRM | F_IMM8;
+static const uint8_t MIZ = F_MODRM | F_IMMZ;
+static const uint8_t R8 = F_IMM8 | F_REL;
+static const uint8_t RZ = F_IMMZ | F_REL;
+
+/**
+ * Operand layout of the one byte opcodes in 64-bit mode.  P marks legacy
+ * and REX prefixes, S opcodes sized in code.
+ */
+static const uint8_t s_oneByte[256] = {
+    M,  M,  M,  M,  I8, IZ, X,  X,  M,  M,  M,  M,  I8, IZ, X,  S,
+    M,  M,  M,  M,  I8, IZ, X,  X,  M,  M,  M,  M,  I8, IZ, X,  X,
+    M,  M,  M,  M,  I8, IZ, P,  X,  M,  M,  M,  M,  I8, IZ, P,  X,
+    M,  M,  M,  M,  I8, IZ, P,  X,  M,  M,  M,  M,  I8, IZ, P,  X,
+    P,  P,  P,  P,  P,  P,  P,  P,  P,  P,  P,  P,  P,  P,  P,  P,
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+    X,  X,  S,  M,  P,  P,  P,  P,  IZ, MIZ,I8, MI8,0,  0,  0,  0,
+    R8, R8, R8, R8, R8, R8, R8, R8, R8, R8, R8, R8, R8, R8, R8, R8,
+    MI8,MIZ,X,  MI8,M,  M,  M,  M,  M,  M,  M,  M,  M,  M,  M,  M,
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  X,  0,  0,  0,  0,  0,
+    S,  S,  S,  S,  0,  0,  0,  0,  I8, IZ, 0,  0,  0,  0,  0,  0,
+    I8, I8, I8, I8, I8, I8, I8, I8, S,  S,  S,  S,  S,  S,  S,  S,
+    MI8,MI8,I16,0,  S,  S,  MI8,MIZ,S,  0,  I16,0,  0,  I8, X,  0,
+    M,  M,  M,  M,  X,  X,  X,  0,  M,  M,  M,  M,  M,  M,  M,  M,
+    R8, R8, R8, R8, I8, I8, I8, I8, RZ, RZ, X,  R8, 0,  0,  0,  0,
+    P,  0,  P,  P,  0,  0,  MS, MS, 0,  0,  0,  0,  0,  0,  M,  M
+};
+
+/**
+ * Operand layout of the 0f opcodes.  0f38 is all ModRM, 0f3a all ModRM
+ * plus imm8.
+ */
+static const uint8_t s_twoByte[256] = {
+    M,  M,  M,  M,  X,  0,  0,  0,  0,  0,  X,  0,  X,  M,  0,  MI8,
+    M,  M,  M,  M,  M,  M,  M,  M,  M,  M,  M,  M,  M,  M,  M,  M,
+    M,  M,  M,  M,  X,  X,  X,  X,  M,  M,  M,  M,  M,  M,  M,  M,
+    0,  0,  0,  0,  0,  0,  X,  0,  S,  X,  S,  X,  X,  X,  X,  X,
+    M,  M,  M,  M,  M,  M,  M,  M,  M,  M,  M,  M,  M,  M,  M,  M,
+    M,  M,  M,  M,  M,  M,  M,  M,  M,  M,  M,  M,  M,  M,  M,  M,
+    M,  M,  M,  M,  M,  M,  M,  M,  M,  M,  M,  M,  M,  M,  M,  M,
+    MI8,MI8,MI8,MI8,M,  M,  M,  0,  M,  M,  X,  X,  M,  M,  M,  M,
+    RZ, RZ, RZ, RZ, RZ, RZ, RZ, RZ, RZ, RZ, RZ, RZ, RZ, RZ, RZ, RZ,
+    M,  M,  M,  M,  M,  M,  M,  M,  M,  M,  M,  M,  M,  M,  M,  M,
+    0,  0,  0,  M,  MI8,M,  X,  X,  0,  0,  0,  M,  MI8,M,  M,  M,
+    M,  M,  M,  M,  M,  M,  M,  M,  M,  M,  MI8,M,  M,  M,  M,  M,
+    M,  M,  MI8,M,  MI8,MI8,MI8,M,  0,  0,  0,  0,  0,  0,  0,  0,
+    M,  M,  M,  M,  M,  M,  M,  M,  M,  M,  M,  M,  M,  M,  M,  M,
+    M,  M,  M,  M,  M,  M,  M,  M,  M,  M,  M,  M,  M,  M,  M,  M,
+    M,  M,  M,  M,  M,  M,  M,  M,  M,  M,  M,  M,  M,  M,  M,  M
+};
+
+static const size_t MAX_LENGTH = 15;
+
+static int64_t ReadSigned(const uint8_t* data, size_t size)
+{
+    switch (size) {
+        case 1: return static_cast<int8_t>(data[0]);
+        case 2: { int16_t value; memcpy(&value, data, 2); return value; }
+        case 4: { int32_t value; memcpy(&value, data, 4); return value; }
+        case 8: { int64_t value; memcpy(&value, data, 8); return value; }
+    }
+    return 0;
+}
+
+bool Instruction::Decode(const uint8_t* code, size_t size)
+{
+    *this = Instruction();
+    if (size > MAX_LENGTH) {
+        size = MAX_LENGTH;
+    }
+
+    // Legacy prefixes, then an optional REX right before the opcode
+    size_t pos = 0;
+    bool bOperand16 = false;
+    bool bAddress32 = false;
+    bool bRexW = false;
+    for (; pos < size && s_oneByte[code[pos]] & F_PREFIX; ++pos) {
+        uint8_t byte = code[pos];
+        if ((byte & 0xf0) == 0x40) {
+            // REX only counts right before the opcode
+            bRexW = byte & 8;
+            continue;
+        }
+        bRexW = false;
+        if (byte == 0x66) {
+            bOperand16 = true;
+        } else if (byte == 0x67) {
+            bAddress32 = true;
+        }
+    }
+    if (pos >= size) {
+        return false;
+    }
+
+    uint8_t flags;
+    uint8_t byte = code[pos++];
+    if (byte == 0xc4 || byte == 0xc5 || byte == 0x62) {
+        // VEX and EVEX: the map comes from the prefix, ModRM always follows
+        size_t prefixSize = byte == 0xc5 ? 1 : byte == 0xc4 ? 2 : 3;
+        if (pos + prefixSize >= size) {
+            return false;
+        }
+        map = byte == 0xc5 ? 1 : code[pos] & (byte == 0xc4 ? 0x1f : 0x07);
+        pos += prefixSize;
+        opcode = code[pos++];
+        if (map == 1) {
+            flags = (s_twoByte[opcode] & F_IMM8) | (opcode == 0x77 ? 0 : F_MODRM);
+        } else if (map == 2 || map == 5 || map == 6) {
+            flags = F_MODRM;
+        } else if (map == 3) {
+            flags = F_MODRM | F_IMM8;
+        } else {
+            return false;
+        }
+    } else if (byte == 0x0f) {
+        if (pos >= size) {
+            return false;
+        }
+        opcode = code[pos++];
+        map = 1;
+        flags = s_twoByte[opcode];
+        if (opcode == 0x38 || opcode == 0x3a) {
+            if (pos >= size) {
+                return false;
+            }
+            map = opcode == 0x38 ? 2 : 3;
+            flags = opcode == 0x38 ? F_MODRM : F_MODRM | F_IMM8;
+            opcode = code[pos++];
+        }
+    } else {
+        opcode = byte;
+        flags = s_oneByte[opcode];
+    }
+    if (flags & F_INVALID) {
+        return false;
+    }
+
+    if (flags & F_MODRM) {
+        if (pos >= size) {
+            return false;
+        }
+        bModRM = true;
+        modrm = code[pos++];
+        uint8_t mod = modrm >> 6;
+        uint8_t rm = modrm & 7;
+        if (mod != 3 && rm == 4) {
+            if (pos >= size) {
+                return false;
+            }
+            uint8_t sib = code[pos++];
+            if (mod == 0 && (sib & 7) == 5) {
+                dispSize = 4;
+            }
+        }
+        if (mod == 0 && rm == 5) {
+            bRipRelative = true;
+            dispSize = 4;
+        } else if (mod == 1) {
+            dispSize = 1;
+        } else if (mod == 2) {
+            dispSize = 4;
+        }
+        if (dispSize) {
+            dispOffset = pos;
+            pos += dispSize;
+        }
+    }
+
+    size_t immZ = bOperand16 && !bRexW ? 2 : 4;
+    if (flags & F_SPECIAL && map == 0) {
+        uint8_t reg = (modrm >> 3) & 7;
+        if (opcode >= 0xa0 && opcode <= 0xa3) {
+            immSize = bAddress32 ? 4 : 8;
+        } else if (opcode >= 0xb8 && opcode <= 0xbf) {
+            immSize = bRexW ? 8 : immZ;
+        } else if (opcode == 0xc8) {
+            immSize = 2;
+            pos++;
+        } else if (opcode == 0xf6 && reg < 2) {
+            immSize = 1;
+        } else if (opcode == 0xf7 && reg < 2) {
+            immSize = immZ;
+        }
+    } else if (flags & F_IMM8) {
+        immSize = 1;
+    } else if (flags & F_IMM16) {
+        immSize = 2;
+    } else if (flags & F_IMMZ) {
+        // Near branches ignore the operand size prefix in 64-bit mode
+        immSize = flags & F_REL ? 4 : immZ;
+    }
+    if (immSize) {
+        immOffset = pos;
+        pos += immSize;
+    }
+    if (pos > size) {
+        return false;
+    }
+
+    length = pos;
+    bBranch = flags & F_REL;
+    if (dispSize) {
+        displacement = ReadSigned(code + dispOffset, dispSize);
+    }
+    if (immSize) {
+        immediate = ReadSigned(code + immOffset, immSize);
+    }
+    return true;
+}
+
+uintptr_t Instruction::GetTarget(uintptr_t address) const
+{
+    if (bBranch) {
+        return address + length + immediate;
+    }
+    if (bRipRelative) {
+        return address + length + displacement;
+    }
+    return 0;
+}
@@ -0,0 +1,32 @@
+#ifndef  __TUXDUMP_DECODER_H__
+#define  __TUXDUMP_DECODER_H__
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * An x86-64 instruction as far as a length decoder sees it: its size, the
+ * opcode and where the displacement and immediate sit.  Enough to follow
+ * references out of code without a full disassembler.
+ */
+struct Instruction {
+    uint8_t length = 0;
+    uint8_t map = 0;            // 0: one byte, 1: 0f, 2: 0f38, 3: 0f3a, 5/6: evex
+    uint8_t opcode = 0;
+    uint8_t modrm = 0;
+    uint8_t dispOffset = 0;
+    uint8_t dispSize = 0;
+    uint8_t immOffset = 0;
+    uint8_t immSize = 0;
+    int32_t displacement = 0;
+    int64_t immediate = 0;
+    bool bModRM = false;
+    bool bRipRelative = false;
+    bool bBranch = false;       // the immediate is a rel8/rel32 branch displacement
+
+    bool Decode(const uint8_t* code, size_t size);
+    bool IsCall() const { return map == 0 && opcode == 0xe8; }
+    bool IsJump() const { return (map == 0 && opcode == 0xe9) || (map == 1 && (opcode & 0xf0) == 0x80); }
+    uintptr_t GetTarget(uintptr_t address) const;
+};
+
+#endif //__TUXDUMP_DECODER_H__
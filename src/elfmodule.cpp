@@ -0,0 +1,363 @@
+#include "elfmodule.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const size_t MAX_PHDRS = 64;
+static const size_t MAX_DYNAMIC = 256;
+static const size_t MAX_CHAIN = 4096;
+
+template<typename Ehdr, typename Phdr>
+static bool ReadHeaders(MemorySource& mem, uintptr_t start, std::vector<Elf64_Phdr>& phdrs)
+{
+    Ehdr ehdr;
+    if (!mem.ReadChecked(start, ehdr) || ehdr.e_phentsize != sizeof(Phdr) || ehdr.e_phnum > MAX_PHDRS) {
+        return false;
+    }
+    Phdr raw[MAX_PHDRS];
+    if (!mem.ReadChecked(start + ehdr.e_phoff, raw, sizeof(Phdr) * ehdr.e_phnum)) {
+        return false;
+    }
+    for (size_t i = 0; i < ehdr.e_phnum; ++i) {
+        Elf64_Phdr phdr;
+        phdr.p_type = raw[i].p_type;
+        phdr.p_flags = raw[i].p_flags;
+        phdr.p_offset = raw[i].p_offset;
+        phdr.p_vaddr = raw[i].p_vaddr;
+        phdr.p_paddr = raw[i].p_paddr;
+        phdr.p_filesz = raw[i].p_filesz;
+        phdr.p_memsz = raw[i].p_memsz;
+        phdr.p_align = raw[i].p_align;
+        phdrs.push_back(phdr);
+    }
+    return true;
+}
+
+bool ElfModule::Load(MemorySource& mem, const Region* module)
+{
+    m_mem = &mem;
+    m_module = module;
+    m_phdrs.clear();
+    m_symtab = m_strtab = m_gnuHash = m_hash = 0;
+    m_bStaticLoaded = false;
+    m_staticSymbols.clear();
+    unsigned char ident[EI_NIDENT];
+    if (!module || !mem.ReadChecked(module->start, ident, sizeof(ident))
+            || memcmp(ident, ELFMAG, SELFMAG)) {
+        return false;
+    }
+
+    m_bIs64 = ident[EI_CLASS] == ELFCLASS64;
+    bool bOk = m_bIs64 ? ReadHeaders<Elf64_Ehdr, Elf64_Phdr>(mem, module->start, m_phdrs)
+            : ReadHeaders<Elf32_Ehdr, Elf32_Phdr>(mem, module->start, m_phdrs);
+    if (!bOk) {
+        Logger::Debug("{}: unreadable program headers", module->name);
+        return false;
+    }
+
+    // The lowest PT_LOAD is mapped at the module start
+    uint64_t lowest = UINT64_MAX;
+    for (const Elf64_Phdr& phdr : m_phdrs) {
+        if (phdr.p_type == PT_LOAD && phdr.p_vaddr < lowest) {
+            lowest = phdr.p_vaddr;
+        }
+    }
+    if (lowest == UINT64_MAX) {
+        return false;
+    }
+    m_bias = module->start - (lowest & ~static_cast<uint64_t>(0xfff));
+    if (!LoadDynamic()) {
+        Logger::Debug("{}: no dynamic symbols", module->name);
+    }
+    return true;
+}
+
+template<typename Dyn>
+static bool ReadDynamic(MemorySource& mem, uintptr_t address, size_t size, std::vector<Elf64_Dyn>& entries)
+{
+    std::vector<Dyn> raw(std::min(size, MAX_DYNAMIC * sizeof(Dyn)) / sizeof(Dyn));
+    if (raw.empty() || !mem.ReadChecked(address, raw.data(), raw.size() * sizeof(Dyn))) {
+        return false;
+    }
+    for (const Dyn& dyn : raw) {
+        if (dyn.d_tag == DT_NULL) {
+            break;
+        }
+        Elf64_Dyn entry;
+        entry.d_tag = dyn.d_tag;
+        entry.d_un.d_ptr = dyn.d_un.d_ptr;
+        entries.push_back(entry);
+    }
+    return true;
+}
+
+/**
+ * The loader rewrites most dynamic pointers to absolute addresses, but
+ * not for every module (or every loader), so values below the module are
+ * still relative.
+ */
+uintptr_t ElfModule::Relocate(uint64_t address) const
+{
+    return address >= m_module->start ? address : m_bias + address;
+}
+
+bool ElfModule::LoadDynamic()
+{
+    const Elf64_Phdr* dynamic = FindSegment(PT_DYNAMIC);
+    if (!dynamic) {
+        return false;
+    }
+    std::vector<Elf64_Dyn> entries;
+    uintptr_t address = m_bias + dynamic->p_vaddr;
+    bool bOk = m_bIs64 ? ReadDynamic<Elf64_Dyn>(*m_mem, address, dynamic->p_memsz, entries)
+            : ReadDynamic<Elf32_Dyn>(*m_mem, address, dynamic->p_memsz, entries);
+    if (!bOk) {
+        return false;
+    }
+    for (const Elf64_Dyn& entry : entries) {
+        switch (entry.d_tag) {
+            case DT_SYMTAB: m_symtab = Relocate(entry.d_un.d_ptr); break;
+            case DT_STRTAB: m_strtab = Relocate(entry.d_un.d_ptr); break;
+            case DT_GNU_HASH: m_gnuHash = Relocate(entry.d_un.d_ptr); break;
+            case DT_HASH: m_hash = Relocate(entry.d_un.d_ptr); break;
+        }
+    }
+    return m_symtab && m_strtab && (m_gnuHash || m_hash);
+}
+
+template<typename Sym>
+uintptr_t ElfModule::CheckSymbol(uint32_t index, const char* name) const
+{
+    Sym sym;
+    char buffer[256];
+    if (!m_mem->ReadChecked(m_symtab + index * sizeof(Sym), sym) || sym.st_shndx == SHN_UNDEF
+            || !m_mem->ReadString(m_strtab + sym.st_name, buffer, sizeof(buffer))
+            || strcmp(buffer, name)) {
+        return 0;
+    }
+    return m_bias + sym.st_value;
+}
+
+/**
+ * DT_GNU_HASH: a bloom filter rules out most misses, then one bucket
+ * leads to a run of symbols whose hashes sit in the chain array.
+ */
+template<typename Sym, typename Word>
+uintptr_t ElfModule::FindGnuSymbol(const char* name) const
+{
+    uint32_t hash = 5381;
+    for (const char* c = name; *c; ++c) {
+        hash = hash * 33 + static_cast<uint8_t>(*c);
+    }
+
+    uint32_t header[4];
+    if (!m_mem->ReadChecked(m_gnuHash, header) || !header[0] || !header[2]) {
+        return 0;
+    }
+    uint32_t buckets = header[0];
+    uint32_t symbolOffset = header[1];
+    uint32_t bloomSize = header[2];
+    uint32_t bloomShift = header[3];
+    const uint32_t bits = sizeof(Word) * 8;
+
+    Word bloom;
+    uintptr_t bloomStart = m_gnuHash + sizeof(header);
+    Word mask = (static_cast<Word>(1) << (hash % bits)) | (static_cast<Word>(1) << ((hash >> bloomShift) % bits));
+    if (!m_mem->ReadChecked(bloomStart + (hash / bits) % bloomSize * sizeof(Word), bloom)
+            || (bloom & mask) != mask) {
+        return 0;
+    }
+
+    uintptr_t bucketStart = bloomStart + bloomSize * sizeof(Word);
+    uintptr_t chainStart = bucketStart + buckets * sizeof(uint32_t);
+    uint32_t index;
+    if (!m_mem->ReadChecked(bucketStart + hash % buckets * sizeof(uint32_t), index) || index < symbolOffset) {
+        return 0;
+    }
+    for (size_t steps = 0; steps < MAX_CHAIN; ++steps, ++index) {
+        uint32_t chain;
+        if (!m_mem->ReadChecked(chainStart + (index - symbolOffset) * sizeof(uint32_t), chain)) {
+            return 0;
+        }
+        if ((chain | 1) == (hash | 1)) {
+            uintptr_t address = CheckSymbol<Sym>(index, name);
+            if (address) {
+                return address;
+            }
+        }
+        if (chain & 1) {
+            break;
+        }
+    }
+    return 0;
+}
+
+/**
+ * DT_HASH: the classic SysV table, for modules linked without GNU hash.
+ */
+template<typename Sym>
+uintptr_t ElfModule::FindSysvSymbol(const char* name) const
+{
+    uint32_t hash = 0;
+    for (const char* c = name; *c; ++c) {
+        hash = (hash << 4) + static_cast<uint8_t>(*c);
+        uint32_t high = hash & 0xf0000000;
+        hash ^= high >> 24;
+        hash &= ~high;
+    }
+
+    uint32_t header[2];
+    if (!m_mem->ReadChecked(m_hash, header) || !header[0]) {
+        return 0;
+    }
+    uintptr_t bucketStart = m_hash + sizeof(header);
+    uintptr_t chainStart = bucketStart + header[0] * sizeof(uint32_t);
+    uint32_t index;
+    if (!m_mem->ReadChecked(bucketStart + hash % header[0] * sizeof(uint32_t), index)) {
+        return 0;
+    }
+    for (size_t steps = 0; index && index < header[1] && steps < MAX_CHAIN; ++steps) {
+        uintptr_t address = CheckSymbol<Sym>(index, name);
+        if (address) {
+            return address;
+        }
+        if (!m_mem->ReadChecked(chainStart + index * sizeof(uint32_t), index)) {
+            return 0;
+        }
+    }
+    return 0;
+}
+
+uintptr_t ElfModule::FindSymbol(const char* name) const
+{
+    if (!m_symtab) {
+        return 0;
+    }
+    if (m_gnuHash) {
+        return m_bIs64 ? FindGnuSymbol<Elf64_Sym, uint64_t>(name) : FindGnuSymbol<Elf32_Sym, uint32_t>(name);
+    }
+    return m_bIs64 ? FindSysvSymbol<Elf64_Sym>(name) : FindSysvSymbol<Elf32_Sym>(name);
+}
+
+const Elf64_Phdr* ElfModule::FindSegment(uint32_t type) const
+{
+    for (const Elf64_Phdr& phdr : m_phdrs) {
+        if (phdr.p_type == type) {
+            return &phdr;
+        }
+    }
+    return nullptr;
+}
+
+bool ElfModule::GetRelro(uintptr_t& start, uintptr_t& end) const
+{
+    const Elf64_Phdr* relro = FindSegment(PT_GNU_RELRO);
+    if (!relro) {
+        return false;
+    }
+    start = m_bias + relro->p_vaddr;
+    end = start + relro->p_memsz;
+    return true;
+}
+
+template<typename Ehdr, typename Phdr, typename Shdr, typename Sym>
+static bool ReadStaticSymbols(const uint8_t* file, size_t size, const std::vector<Elf64_Phdr>& phdrs,
+        std::unordered_map<std::string, uint64_t>& symbols)
+{
+    Ehdr ehdr;
+    if (size < sizeof(ehdr)) {
+        return false;
+    }
+    memcpy(&ehdr, file, sizeof(ehdr));
+
+    // The file on disk has to be the one that is mapped
+    if (ehdr.e_phentsize != sizeof(Phdr) || ehdr.e_phnum != phdrs.size() || ehdr.e_phoff > size
+            || ehdr.e_phnum > (size - ehdr.e_phoff) / sizeof(Phdr)) {
+        return false;
+    }
+    for (size_t i = 0; i < phdrs.size(); ++i) {
+        Phdr phdr;
+        memcpy(&phdr, file + ehdr.e_phoff + i * sizeof(phdr), sizeof(phdr));
+        if (phdr.p_type != phdrs[i].p_type || phdr.p_vaddr != phdrs[i].p_vaddr
+                || phdr.p_memsz != phdrs[i].p_memsz) {
+            return false;
+        }
+    }
+
+    if (ehdr.e_shentsize != sizeof(Shdr) || ehdr.e_shoff > size
+            || ehdr.e_shnum > (size - ehdr.e_shoff) / sizeof(Shdr)) {
+        return false;
+    }
+    const uint8_t* sections = file + ehdr.e_shoff;
+    for (size_t i = 0; i < ehdr.e_shnum; ++i) {
+        Shdr symtab;
+        Shdr strtab;
+        memcpy(&symtab, sections + i * sizeof(symtab), sizeof(symtab));
+        if (symtab.sh_type != SHT_SYMTAB || symtab.sh_link >= ehdr.e_shnum) {
+            continue;
+        }
+        memcpy(&strtab, sections + symtab.sh_link * sizeof(strtab), sizeof(strtab));
+        if (symtab.sh_offset > size || symtab.sh_size > size - symtab.sh_offset
+                || strtab.sh_offset > size || strtab.sh_size > size - strtab.sh_offset) {
+            continue;
+        }
+        const char* strings = reinterpret_cast<const char*>(file + strtab.sh_offset);
+        for (size_t j = 0; j < symtab.sh_size / sizeof(Sym); ++j) {
+            Sym sym;
+            memcpy(&sym, file + symtab.sh_offset + j * sizeof(sym), sizeof(sym));
+            if (sym.st_shndx == SHN_UNDEF || !sym.st_name || sym.st_name >= strtab.sh_size) {
+                continue;
+            }
+            size_t length = strnlen(strings + sym.st_name, strtab.sh_size - sym.st_name);
+            symbols.emplace(std::string(strings + sym.st_name, length), sym.st_value);
+        }
+    }
+    return true;
+}
+
+bool ElfModule::LoadStaticSymbols()
+{
+    int fd = open(m_module->path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) || !st.st_size) {
+        close(fd);
+        return false;
+    }
+    void* mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        return false;
+    }
+    const uint8_t* file = static_cast<const uint8_t*>(mapped);
+    bool bOk = m_bIs64
+            ? ReadStaticSymbols<Elf64_Ehdr, Elf64_Phdr, Elf64_Shdr, Elf64_Sym>(file, st.st_size, m_phdrs, m_staticSymbols)
+            : ReadStaticSymbols<Elf32_Ehdr, Elf32_Phdr, Elf32_Shdr, Elf32_Sym>(file, st.st_size, m_phdrs, m_staticSymbols);
+    munmap(mapped, st.st_size);
+    return bOk;
+}
+
+uintptr_t ElfModule::FindStaticSymbol(const char* name)
+{
+    if (!m_module) {
+        return 0;
+    }
+    if (!m_bStaticLoaded) {
+        m_bStaticLoaded = true;
+        if (!LoadStaticSymbols()) {
+            Logger::Debug("{}: no .symtab in {}", m_module->name, m_module->path);
+        } else {
+            Logger::Debug("{}: {} static symbols", m_module->name, m_staticSymbols.size());
+        }
+    }
+    auto it = m_staticSymbols.find(name);
+    return it != m_staticSymbols.end() ? m_bias + it->second : 0;
+}
@@ -0,0 +1,52 @@
+#ifndef  __TUXDUMP_ELFMODULE_H__
+#define  __TUXDUMP_ELFMODULE_H__
+#include "memory/source.h"
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <elf.h>
+
+/**
+ * The program headers and dynamic symbols of a loaded module, read from
+ * its first mapping.  32-bit headers are widened to the 64-bit layout.
+ * Addresses returned are absolute, the load bias already applied.  The
+ * .symtab is not mapped; it is read from the module's file on first use,
+ * and only if that file has the program headers found in memory.
+ */
+class ElfModule {
+    public:
+        bool Load(MemorySource& mem, const Region* module);
+        bool Is64() const { return m_bIs64; }
+        uintptr_t GetBias() const { return m_bias; }
+        const Elf64_Phdr* FindSegment(uint32_t type) const;
+        bool GetRelro(uintptr_t& start, uintptr_t& end) const;
+        uintptr_t FindSymbol(const char* name) const;
+        uintptr_t FindStaticSymbol(const char* name);
+    private:
+        bool LoadDynamic();
+        bool LoadStaticSymbols();
+        uintptr_t Relocate(uint64_t address) const;
+        template<typename Sym>
+        uintptr_t CheckSymbol(uint32_t index, const char* name) const;
+        template<typename Sym, typename Word>
+        uintptr_t FindGnuSymbol(const char* name) const;
+        template<typename Sym>
+        uintptr_t FindSysvSymbol(const char* name) const;
+    private:
+        MemorySource* m_mem = nullptr;
+        const Region* m_module = nullptr;
+        bool m_bIs64 = true;
+        uintptr_t m_bias = 0;
+        std::vector<Elf64_Phdr> m_phdrs;
+        uintptr_t m_symtab = 0;
+        uintptr_t m_strtab = 0;
+        uintptr_t m_gnuHash = 0;
+        uintptr_t m_hash = 0;
+        bool m_bStaticLoaded = false;
+        std::unordered_map<std::string, uint64_t> m_staticSymbols;
+};
+
+#endif //__TUXDUMP_ELFMODULE_H__
@@ -0,0 +1,65 @@
+#include "filter.h"
+
+#include <algorithm>
+
+#include <fnmatch.h>
+
+bool NameFilter::MatchesAny(const std::vector<std::string>& globs, const std::string& name)
+{
+    // Try the name itself and every enclosing scope
+    for (const std::string& glob : globs) {
+        size_t end = name.size();
+        for (;;) {
+            if (!fnmatch(glob.c_str(), name.substr(0, end).c_str(), 0)) {
+                return true;
+            }
+            size_t dot = name.rfind('.', end - 1);
+            if (dot == std::string::npos || dot == 0) {
+                break;
+            }
+            end = dot;
+        }
+    }
+    return false;
+}
+
+bool NameFilter::CouldExtend(const std::string& glob, const std::string& prefix)
+{
+    // Conservative: compare up to the first wildcard
+    size_t literal = glob.find_first_of("*?[");
+    if (literal == std::string::npos) {
+        return glob.size() > prefix.size() && !glob.compare(0, prefix.size(), prefix);
+    }
+    size_t length = std::min(literal, prefix.size());
+    return !glob.compare(0, length, prefix, 0, length);
+}
+
+bool NameFilter::Matches(const std::string& name) const
+{
+    if (MatchesAny(m_exclude, name)) {
+        return false;
+    }
+    return m_include.empty() || MatchesAny(m_include, name);
+}
+
+bool NameFilter::MayContain(const std::string& scope) const
+{
+    if (MatchesAny(m_exclude, scope)) {
+        return false;
+    }
+    std::string prefix = scope + ".";
+    for (const std::string& glob : m_exclude) {
+        if (glob.back() == '*' && !fnmatch(glob.c_str(), prefix.c_str(), 0)) {
+            return false;
+        }
+    }
+    if (m_include.empty() || MatchesAny(m_include, scope)) {
+        return true;
+    }
+    for (const std::string& glob : m_include) {
+        if (CouldExtend(glob, prefix)) {
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,27 @@
+#ifndef  __TUXDUMP_FILTER_H__
+#define  __TUXDUMP_FILTER_H__
+#include <string>
+#include <vector>
+
+/**
+ * --only / --exclude globs (fnmatch syntax) over dotted names such as
+ * "dwClientState" or "DT_CSPlayer.m_iHealth".  A glob that matches a
+ * name also covers everything below it, so "DT_CSPlayer" selects the
+ * whole table.
+ */
+class NameFilter {
+    public:
+        void Include(const std::string& glob) { m_include.push_back(glob); }
+        void Exclude(const std::string& glob) { m_exclude.push_back(glob); }
+        bool IsEmpty() const { return m_include.empty() && m_exclude.empty(); }
+        bool Matches(const std::string& name) const;
+        bool MayContain(const std::string& scope) const;
+    private:
+        static bool MatchesAny(const std::vector<std::string>& globs, const std::string& name);
+        static bool CouldExtend(const std::string& glob, const std::string& prefix);
+    private:
+        std::vector<std::string> m_include;
+        std::vector<std::string> m_exclude;
+};
+
+#endif //__TUXDUMP_FILTER_H__
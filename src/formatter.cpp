@@ -90,7 +90,7 @@ void Formatter::PrintRecursive(rapidjson::Value::ConstMemberIterator object)
         m_depth--;
         Indent();
         fmt::print(stdout, m_fmtTableEnd, scope);
-    } else if (object->value.IsInt()) {
+    } else if (object->value.IsInt() || object->value.IsUint64()) {
         for (const std::pair<char, char>& replacements : m_fmtReplaceChars) {
             size_t pos = scope.find(replacements.first);
             while (pos != std::string::npos) {
@@ -105,7 +105,12 @@ void Formatter::PrintRecursive(rapidjson::Value::ConstMemberIterator object)
             }
         }
         Indent();
-        fmt::print(stdout, m_fmtOffset, scope, object->value.GetUint());
+        if (object->value.IsUint()) {
+            fmt::print(stdout, m_fmtOffset, scope, object->value.GetUint());
+        } else {
+            // Absolute addresses, e.g. interface factories
+            fmt::print(stdout, m_fmtOffset, scope, object->value.GetUint64());
+        }
     }
 }
 
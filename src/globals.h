@@ -1,9 +0,0 @@
-#ifndef  __TUXDUMP_GLOBALS_H__
-#define  __TUXDUMP_GLOBALS_H__
-#include <tuxproc/process.h>
-#include <libconfig.h++>
-
-extern TuxProc::Process g_process;
-extern libconfig::Config g_cfg;
-
-#endif
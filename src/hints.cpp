@@ -0,0 +1,80 @@
+#include "hints.h"
+
+#include <cstdio>
+#include <map>
+
+#include <rapidjson/document.h>
+#include <rapidjson/filereadstream.h>
+#include <rapidjson/filewritestream.h>
+#include <rapidjson/prettywriter.h>
+
+bool Hints::Load(const char* path)
+{
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        return false;
+    }
+    char buffer[65536];
+    rapidjson::FileReadStream stream(file, buffer, sizeof(buffer));
+    rapidjson::Document doc;
+    doc.ParseStream(stream);
+    fclose(file);
+    if (doc.HasParseError() || !doc.IsObject()) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto it = doc.MemberBegin(); it != doc.MemberEnd(); ++it) {
+        if (it->value.IsUint64()) {
+            m_offsets[it->name.GetString()] = it->value.GetUint64();
+        }
+    }
+    m_bDirty = false;
+    return true;
+}
+
+bool Hints::Save(const char* path)
+{
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        return false;
+    }
+
+    // Sorted, so the file diffs cleanly between runs
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::map<std::string, uint64_t> sorted(m_offsets.begin(), m_offsets.end());
+    char buffer[65536];
+    rapidjson::FileWriteStream stream(file, buffer, sizeof(buffer));
+    rapidjson::PrettyWriter<rapidjson::FileWriteStream> writer(stream);
+    writer.StartObject();
+    for (const auto& hint : sorted) {
+        writer.Key(hint.first.c_str());
+        writer.Uint64(hint.second);
+    }
+    writer.EndObject();
+    stream.Put('\n');
+    stream.Flush();
+    m_bDirty = false;
+    return fclose(file) == 0;
+}
+
+bool Hints::Get(const std::string& name, uint64_t& offset)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_offsets.find(name);
+    if (it == m_offsets.end()) {
+        return false;
+    }
+    offset = it->second;
+    return true;
+}
+
+void Hints::Set(const std::string& name, uint64_t offset)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_offsets.find(name);
+    if (it == m_offsets.end() || it->second != offset) {
+        m_offsets[name] = offset;
+        m_bDirty = true;
+    }
+}
@@ -0,0 +1,26 @@
+#ifndef  __TUXDUMP_HINTS_H__
+#define  __TUXDUMP_HINTS_H__
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/**
+ * Module-relative match offsets from a previous run, keyed by signature
+ * name.  Stored as a flat JSON object; the scanner searches around these
+ * first.
+ */
+class Hints {
+    public:
+        bool Load(const char* path);
+        bool Save(const char* path);
+        bool Get(const std::string& name, uint64_t& offset);
+        void Set(const std::string& name, uint64_t offset);
+        bool IsDirty() const { return m_bDirty; }
+    private:
+        std::mutex m_mutex;
+        std::unordered_map<std::string, uint64_t> m_offsets;
+        bool m_bDirty = false;
+};
+
+#endif //__TUXDUMP_HINTS_H__
@@ -0,0 +1,240 @@
+#include "interfaces.h"
+#include "decoder.h"
+#include "elfmodule.h"
+#include "logger.h"
+
+#include <cstring>
+
+static const size_t MAX_NAME = 128;
+static const size_t MAX_INSTRUCTIONS = 32;
+static const size_t MAX_INTERFACES = 4096;
+
+namespace {
+
+/**
+ * InterfaceReg as laid out by tier1, in the module's pointer size:
+ * {m_CreateFn, m_pName, m_pNext}.
+ */
+struct RawInterfaceReg {
+    uint8_t data[3 * sizeof(uint64_t)];
+
+    uintptr_t Get(size_t index, bool bIs64) const
+    {
+        if (bIs64) {
+            uint64_t value;
+            memcpy(&value, data + index * sizeof(value), sizeof(value));
+            return value;
+        }
+        uint32_t value;
+        memcpy(&value, data + index * sizeof(value), sizeof(value));
+        return value;
+    }
+};
+
+}
+
+static bool IsUnconditionalJump(const Instruction& insn)
+{
+    return insn.map == 0 && (insn.opcode == 0xe9 || insn.opcode == 0xeb);
+}
+
+static bool IsReturn(const Instruction& insn)
+{
+    return insn.map == 0 && insn.opcode == 0xc3;
+}
+
+/**
+ * CreateInterface walks InterfaceReg::s_pInterfaceRegs, inlined or through
+ * a call or jmp to CreateInterfaceInternal.  The first RIP-relative load is
+ * either the list head itself or its GOT slot, the latter dereferenced
+ * right away by the next instruction.
+ */
+static uintptr_t FindListFromCode(Scanner& scanner, uintptr_t function)
+{
+    Instruction insn;
+    bool bFollowed = false;
+    for (size_t i = 0; i < MAX_INSTRUCTIONS; ++i) {
+        uintptr_t at = scanner.Decode(function, i, insn);
+        if (!at || IsReturn(insn)) {
+            break;
+        }
+        if (!bFollowed && (insn.IsCall() || IsUnconditionalJump(insn))) {
+            bFollowed = true;
+            function = insn.GetTarget(at);
+            i = static_cast<size_t>(-1);
+            continue;
+        }
+        if (insn.map != 0 || insn.opcode != 0x8b || !insn.bRipRelative) {
+            continue;
+        }
+        uintptr_t target = insn.GetTarget(at);
+        uint8_t reg = (insn.modrm >> 3) & 7;
+        Instruction next;
+        if (scanner.Decode(function, i + 1, next) && next.map == 0 && next.opcode == 0x8b
+                && next.modrm >> 6 == 0 && (next.modrm & 7) == reg && reg != 4 && reg != 5) {
+            uintptr_t list;
+            return scanner.Read(target, &list, sizeof(list)) ? list : 0;
+        }
+        return target;
+    }
+    return 0;
+}
+
+static bool FindList(Scanner& scanner, MemorySource& mem, const Region* region, InterfaceRegistry::Module& module)
+{
+    ElfModule elf;
+    if (!elf.Load(mem, region)) {
+        return false;
+    }
+    uintptr_t create = elf.FindSymbol("CreateInterface");
+    if (!create) {
+        return false;
+    }
+    module.region = region;
+    module.bIs64 = elf.Is64();
+    module.list = elf.FindSymbol("_ZN12InterfaceReg16s_pInterfaceRegsE");
+    if (!module.list && module.bIs64) {
+        module.list = FindListFromCode(scanner, create);
+    }
+    if (!module.list) {
+        Logger::Debug("{}: CreateInterface without a readable InterfaceReg list", region->name);
+        return false;
+    }
+    return true;
+}
+
+void InterfaceRegistry::Build(MemorySource& mem, Scanner& scanner, ThreadPool& pool)
+{
+    const std::vector<Region>& regions = mem.GetModules();
+    std::vector<Module> found(regions.size());
+    std::vector<char> bFound(regions.size(), 0);
+    pool.ParallelFor(regions.size(), [&](size_t i) {
+        bFound[i] = FindList(scanner, mem, &regions[i], found[i]);
+    });
+
+    m_modules.clear();
+    for (size_t i = 0; i < regions.size(); ++i) {
+        if (bFound[i]) {
+            m_modules.push_back(found[i]);
+        }
+    }
+    WalkLists(mem);
+}
+
+/**
+ * Walks every list one hop at a time, so each depth costs two vectored
+ * reads however many modules there are: the entries, then their names.
+ */
+void InterfaceRegistry::WalkLists(MemorySource& mem)
+{
+    std::vector<ReadOp> ops;
+    std::vector<uint64_t> heads(m_modules.size());
+    for (size_t i = 0; i < m_modules.size(); ++i) {
+        ops.push_back({m_modules[i].list, &heads[i], m_modules[i].bIs64 ? 8u : 4u, 0});
+    }
+    mem.ReadCheckedV(ops.data(), ops.size());
+    std::vector<uintptr_t> nodes(m_modules.size());
+    for (size_t i = 0; i < m_modules.size(); ++i) {
+        if (ops[i].result == static_cast<ssize_t>(ops[i].size)) {
+            nodes[i] = m_modules[i].bIs64 ? heads[i] : static_cast<uint32_t>(heads[i]);
+        }
+    }
+
+    std::vector<size_t> active;
+    std::vector<RawInterfaceReg> regs;
+    std::vector<ReadOp> nameOps;
+    std::vector<char> names;
+    for (size_t depth = 0; depth < MAX_INTERFACES; ++depth) {
+        active.clear();
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            if (nodes[i]) {
+                active.push_back(i);
+            }
+        }
+        if (active.empty()) {
+            break;
+        }
+
+        ops.clear();
+        regs.resize(active.size());
+        for (size_t i = 0; i < active.size(); ++i) {
+            size_t pointer = m_modules[active[i]].bIs64 ? 8 : 4;
+            ops.push_back({nodes[active[i]], regs[i].data, pointer * 3, 0});
+        }
+        mem.ReadCheckedV(ops.data(), ops.size());
+
+        nameOps.clear();
+        names.assign(active.size() * MAX_NAME, 0);
+        for (size_t i = 0; i < active.size(); ++i) {
+            uintptr_t name = 0;
+            if (ops[i].result == static_cast<ssize_t>(ops[i].size)) {
+                name = regs[i].Get(1, m_modules[active[i]].bIs64);
+            }
+            size_t size = name ? mem.GetReadableSize(name, MAX_NAME - 1) : 0;
+            nameOps.push_back({name, &names[i * MAX_NAME], size, 0});
+        }
+        mem.ReadCheckedV(nameOps.data(), nameOps.size());
+
+        for (size_t i = 0; i < active.size(); ++i) {
+            Module& module = m_modules[active[i]];
+            uintptr_t& node = nodes[active[i]];
+            if (!nameOps[i].size || nameOps[i].result != static_cast<ssize_t>(nameOps[i].size)) {
+                Logger::Debug("{}: unreadable InterfaceReg at {:#x}", module.region->name, node);
+                node = 0;
+                continue;
+            }
+            const char* name = &names[i * MAX_NAME];
+            module.interfaces.push_back({std::string(name, strnlen(name, nameOps[i].size)),
+                    regs[i].Get(0, module.bIs64)});
+            node = regs[i].Get(2, module.bIs64);
+        }
+    }
+}
+
+/**
+ * The newest version of an interface: the greatest name starting with
+ * prefix, e.g. VEngineCvar007 for "VEngineCvar".
+ */
+const InterfaceRegistry::Interface* InterfaceRegistry::Find(const char* prefix, const Module** module) const
+{
+    size_t length = strlen(prefix);
+    const Interface* best = nullptr;
+    for (const Module& candidate : m_modules) {
+        for (const Interface& interface : candidate.interfaces) {
+            if (!interface.name.compare(0, length, prefix) && (!best || interface.name > best->name)) {
+                best = &interface;
+                if (module) {
+                    *module = &candidate;
+                }
+            }
+        }
+    }
+    return best;
+}
+
+/**
+ * The object a singleton factory returns: the target of its RIP-relative
+ * lea, or the pointer its GOT load reads.  Factories that allocate have
+ * no fixed instance and give 0.
+ */
+uintptr_t InterfaceRegistry::GetInstance(Scanner& scanner, uintptr_t factory)
+{
+    Instruction insn;
+    for (size_t i = 0; i < MAX_INSTRUCTIONS; ++i) {
+        uintptr_t at = scanner.Decode(factory, i, insn);
+        if (!at || IsReturn(insn) || insn.IsCall()) {
+            break;
+        }
+        if (insn.map != 0 || !insn.bRipRelative) {
+            continue;
+        }
+        if (insn.opcode == 0x8d) {
+            return insn.GetTarget(at);
+        }
+        if (insn.opcode == 0x8b) {
+            uintptr_t instance;
+            return scanner.Read(insn.GetTarget(at), &instance, sizeof(instance)) ? instance : 0;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,40 @@
+#ifndef  __TUXDUMP_INTERFACES_H__
+#define  __TUXDUMP_INTERFACES_H__
+#include "memory/source.h"
+#include "scanner.h"
+#include "threadpool.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * The interfaces every loaded module registers with CreateInterface.  The
+ * export is found through the dynamic symbol table and followed to its
+ * InterfaceReg list; the lists of all modules are then walked together,
+ * one vectored read per hop.
+ */
+class InterfaceRegistry {
+    public:
+        struct Interface {
+            std::string name;
+            uintptr_t factory;
+        };
+        struct Module {
+            const Region* region;
+            bool bIs64;
+            uintptr_t list;                 // &InterfaceReg::s_pInterfaceRegs
+            std::vector<Interface> interfaces;
+        };
+    public:
+        void Build(MemorySource& mem, Scanner& scanner, ThreadPool& pool);
+        const std::vector<Module>& GetModules() const { return m_modules; }
+        const Interface* Find(const char* prefix, const Module** module = nullptr) const;
+        static uintptr_t GetInstance(Scanner& scanner, uintptr_t factory);
+    private:
+        void WalkLists(MemorySource& mem);
+    private:
+        std::vector<Module> m_modules;
+};
+
+#endif //__TUXDUMP_INTERFACES_H__
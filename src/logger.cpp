@@ -0,0 +1,40 @@
+#include "logger.h"
+
+#include <cerrno>
+
+#include <unistd.h>
+
+std::atomic<int> Logger::s_level(Logger::Level_Info);
+
+fmt::memory_buffer& Logger::GetBuffer()
+{
+    static thread_local fmt::memory_buffer buffer;
+    return buffer;
+}
+
+void Logger::Flush(const fmt::memory_buffer& buffer)
+{
+    const char* data = buffer.data();
+    size_t left = buffer.size();
+    while (left) {
+        ssize_t written = write(STDERR_FILENO, data, left);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        data += written;
+        left -= written;
+    }
+}
+
+void Logger::EOL()
+{
+    if (IsEnabled(Level_Info)) {
+        fmt::memory_buffer& buffer = GetBuffer();
+        buffer.clear();
+        buffer.push_back('\n');
+        Flush(buffer);
+    }
+}
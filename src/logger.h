@@ -1,53 +1,128 @@
 #ifndef __TUXDUMP_LOGGER_H__
 #define __TUXDUMP_LOGGER_H__
+#include <atomic>
+#include <cstring>
+#include <iterator>
+
 #include <fmt/format.h>
 
+#define TUXDUMP_LOG_TRACE 0
+#define TUXDUMP_LOG_DEBUG 1
+#define TUXDUMP_LOG_INFO  2
+#define TUXDUMP_LOG_WARN  3
+#define TUXDUMP_LOG_ERROR 4
+
+/**
+ * Trace and Debug messages below TUXDUMP_LOG_LEVEL are compiled out, the
+ * rest are checked against the runtime level (Info unless changed with
+ * SetLevel).  Output, warnings and errors are always compiled in.
+ */
+#ifndef TUXDUMP_LOG_LEVEL
+#define TUXDUMP_LOG_LEVEL TUXDUMP_LOG_TRACE
+#endif
+
+/**
+ * Leveled logging to stderr.  Each message is formatted into a per-thread
+ * buffer and written with a single write(), so lines from different
+ * threads never interleave.
+ */
 class Logger {
+    public:
+        enum Level {
+            Level_Trace = TUXDUMP_LOG_TRACE,
+            Level_Debug = TUXDUMP_LOG_DEBUG,
+            Level_Info = TUXDUMP_LOG_INFO,
+            Level_Warn = TUXDUMP_LOG_WARN,
+            Level_Error = TUXDUMP_LOG_ERROR
+        };
     public:
         Logger() = delete;
+        static inline bool IsEnabled(Level level);
+        static void SetLevel(Level level) { s_level.store(level, std::memory_order_relaxed); }
+
+        template<typename... Targs>
+        static inline void Trace(const char* fmt, const Targs&... args);
         template<typename... Targs>
-        static inline void Error(const char* fmt, Targs... args);
+        static inline void Debug(const char* fmt, const Targs&... args);
         template<typename... Targs>
-        static inline void Log(const char* fmt, Targs... args);
+        static inline void Error(const char* fmt, const Targs&... args);
         template<typename... Targs>
-        static inline void Print(const char* fmt, Targs... args);
+        static inline void Log(const char* fmt, const Targs&... args);
         template<typename... Targs>
-        static inline void Warn(const char* fmt, Targs... args);
-        static inline void EOL();
+        static inline void Print(const char* fmt, const Targs&... args);
+        template<typename... Targs>
+        static inline void Warn(const char* fmt, const Targs&... args);
+        static void EOL();
+    private:
+        template<typename... Targs>
+        static inline void Write(const char* prefix, const char* fmt, const Targs&... args);
+        static fmt::memory_buffer& GetBuffer();
+        static void Flush(const fmt::memory_buffer& buffer);
+    private:
+        static std::atomic<int> s_level;
 };
 
+inline bool Logger::IsEnabled(Level level)
+{
+    return (level > TUXDUMP_LOG_DEBUG || level >= TUXDUMP_LOG_LEVEL)
+        && level >= s_level.load(std::memory_order_relaxed);
+}
+
 template<typename... Targs>
-inline void Logger::Error(const char* fmt, Targs... args)
+inline void Logger::Write(const char* prefix, const char* fmt, const Targs&... args)
 {
-    fmt::print(stderr, "[ERR] ");
-    fmt::print(stderr, fmt, args...);
-    fmt::print(stderr, "\n");
+    fmt::memory_buffer& buffer = GetBuffer();
+    buffer.clear();
+    buffer.append(prefix, prefix + strlen(prefix));
+    fmt::format_to(std::back_inserter(buffer), fmt, args...);
+    buffer.push_back('\n');
+    Flush(buffer);
 }
 
 template<typename... Targs>
-inline void Logger::Log(const char* fmt, Targs... args)
+inline void Logger::Trace(const char* fmt, const Targs&... args)
 {
-    fmt::print(stderr, fmt, args...);
-    fmt::print(stderr, "\n");
+    if (IsEnabled(Level_Trace)) {
+        Write("[TRACE] ", fmt, args...);
+    }
 }
 
 template<typename... Targs>
-inline void Logger::Print(const char* fmt, Targs... args)
+inline void Logger::Debug(const char* fmt, const Targs&... args)
 {
-    fmt::print(stdout, fmt, args...);
+    if (IsEnabled(Level_Debug)) {
+        Write("[DEBUG] ", fmt, args...);
+    }
+}
+
+template<typename... Targs>
+inline void Logger::Error(const char* fmt, const Targs&... args)
+{
+    if (IsEnabled(Level_Error)) {
+        Write("[ERR] ", fmt, args...);
+    }
 }
 
 template<typename... Targs>
-inline void Logger::Warn(const char* fmt, Targs... args)
+inline void Logger::Log(const char* fmt, const Targs&... args)
 {
-    fmt::print(stderr, "[WARN] ");
-    fmt::print(stderr, fmt, args...);
-    fmt::print(stderr, "\n");
+    if (IsEnabled(Level_Info)) {
+        Write("", fmt, args...);
+    }
 }
 
-inline void Logger::EOL()
+template<typename... Targs>
+inline void Logger::Print(const char* fmt, const Targs&... args)
+{
+    fmt::print(stdout, fmt, args...);
+}
+
+template<typename... Targs>
+inline void Logger::Warn(const char* fmt, const Targs&... args)
 {
-    fmt::print(stderr, "\n");
+    if (IsEnabled(Level_Warn)) {
+        Write("[WARN] ", fmt, args...);
+    }
 }
 
 #endif //__TUXDUMP_LOGGER_H__
@@ -1,63 +1,53 @@
-#include "tools/tools.h"
-#include "formatter.h"
-#include "globals.h"
+#include "tuxdump.h"
 #include "logger.h"
 
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 
+#include <getopt.h>
 #include <strings.h>
 #include <unistd.h>
 
-TuxProc::Process g_process;
-libconfig::Config g_cfg;
-
 constexpr const char validTools[][20] = {
+    "classes",
     "classids",
+    "convars",
+    "datamaps",
+    "interfaces",
     "netvars",
-    "signatures"
+    "serve",
+    "signatures",
+    "snapshot"
 };
 
-static bool ReadSignatureConfig(const char* configFile)
-{
-    try {
-        g_cfg.readFile(configFile);
-    } catch (const libconfig::FileIOException& fioex) {
-        return false;
-    } catch (const libconfig::ParseException& pex) {
-        Logger::Error("Parse exception: {}\nFile: {}:{}\n", 
-                pex.getError(), configFile, pex.getLine());
-        return false;
-    }
-    // Validate config structure
-    try {
-        libconfig::Setting& signatures = g_cfg.lookup("signatures");
-        for (libconfig::Setting& entry : signatures) {
-            entry.lookup("pattern");
-            entry.lookup("region");
-            entry.lookup("offset");
-            entry.lookup("extra");
-            entry.lookup("relative");
-        }
-        signatures.lookup("dwGetAllClasses");
-        signatures.lookup("dwGetAllClasses.offset");
-        signatures.lookup("dwGetAllClasses.pattern");
-    } catch (const libconfig::SettingNotFoundException& snfex) {
-        Logger::Error("{}: {}", snfex.what(), snfex.getPath());
-        return false;
-    }
-    return true;
-}
-
-static void RunTool(const char* cmdTool, Formatter& fmt)
+/**
+ * Runs the named tool, false if it failed.  Tools that only print have no
+ * way to fail.
+ */
+static bool RunTool(const char* cmdTool, Context& ctx, Formatter& fmt,
+        const char* cmdSocket, const char* cmdOutput)
 {
-    if (!strcasecmp(cmdTool, "classids")) {
+    if (!strcasecmp(cmdTool, "classes")) {
+        Tools::DumpClasses(ctx, fmt);
+    } else if (!strcasecmp(cmdTool, "classids")) {
         //run tool classids
+    } else if (!strcasecmp(cmdTool, "convars")) {
+        Tools::DumpConvars(ctx, fmt);
+    } else if (!strcasecmp(cmdTool, "datamaps")) {
+        Tools::DumpDataMaps(ctx, fmt);
+    } else if (!strcasecmp(cmdTool, "interfaces")) {
+        Tools::DumpInterfaces(ctx, fmt);
     } else if (!strcasecmp(cmdTool, "netvars")) {
-        Tools::DumpNetvars(fmt);
+        Tools::DumpNetvars(ctx, fmt);
+    } else if (!strcasecmp(cmdTool, "serve")) {
+        return Tools::Serve(ctx, cmdSocket);
     } else if (!strcasecmp(cmdTool, "signatures")) {
-        Tools::DumpSignatures(fmt);
+        Tools::DumpSignatures(ctx, fmt);
+    } else if (!strcasecmp(cmdTool, "snapshot")) {
+        return Tools::Snapshot(ctx, cmdOutput);
     }
+    return true;
 }
 
 static bool CheckTool(const char* cmdTool)
@@ -110,9 +100,15 @@ static void PrintHelpFormats()
 static void PrintHelpTools()
 {
     Logger::Log("Available Tools:");
+    PrintOption("classes", "vtables and bases from RTTI");
     PrintOption("classids", "enumerated list of classids");
+    PrintOption("convars", "console variables and commands");
+    PrintOption("datamaps", "prediction and save/restore field offsets");
+    PrintOption("interfaces", "factories registered with CreateInterface");
     PrintOption("netvars", "netvar offsets");
+    PrintOption("serve", "answer offset queries over a unix socket");
     PrintOption("signatures", "memory addresses defined in config");
+    PrintOption("snapshot", "save the target's modules for offline dumps");
     Logger::EOL();
 }
 
@@ -120,9 +116,20 @@ static void PrintHelpOptions()
 {
     Logger::Log("Options:");
     PrintOption("-c[filename]", "config file to use");
+    PrintOption("-C[filename]", "read memory from an ELF core file");
     PrintOption("-f[format]", "language formatting");
     PrintOption("-h", "this message");
+    PrintOption("-j[threads]", "worker threads (default: all cores)");
+    PrintOption("-o[filename]", "output file for the snapshot tool");
     PrintOption("-p[process]", "name of process to attach");
+    PrintOption("-s[socket]", "socket path for the serve tool");
+    PrintOption("-S[filename]", "read memory from a snapshot file");
+    PrintOption("-v", "debug output, twice for tracing");
+    PrintOption("--stats", "print timings and counters to stderr");
+    PrintOption("--trace=[file]", "write a chrome trace of the run");
+    PrintOption("--only=[glob]", "dump only matching names, e.g. 'DT_CSPlayer.*'");
+    PrintOption("--exclude=[glob]", "skip matching names");
+    PrintOption("--hints=[file]", "scan near the matches recorded in file, then update it");
     Logger::EOL();
 }
 
@@ -142,33 +149,81 @@ static void PrintHelpAll()
 
 int main(int argc, char* argv[])
 {
-    if (getuid() != 0) {
-        Logger::Error("This software requires root privileges to run.");
-        return 1;
-    }
     const char* cmdConfig = "csgo.cfg";
+    const char* cmdCore = nullptr;
     const char* cmdFormat = "json";
     const char* cmdProcess = "csgo_linux64";
+    const char* cmdOutput = "tuxdump.snap";
+    const char* cmdSnapshot = nullptr;
+    const char* cmdSocket = "/tmp/tuxdump.sock";
     const char* cmdTool = "signatures";
+    const char* cmdTrace = nullptr;
+    const char* cmdHints = nullptr;
+    bool bStats = false;
+    int verbosity = 0;
+    size_t threads = 0;
+    NameFilter filter;
+
+    static const option longOptions[] = {
+        {"stats", no_argument, nullptr, 1},
+        {"trace", required_argument, nullptr, 2},
+        {"only", required_argument, nullptr, 3},
+        {"exclude", required_argument, nullptr, 4},
+        {"hints", required_argument, nullptr, 5},
+        {nullptr, 0, nullptr, 0}
+    };
 
     int c;
     opterr = 0;
-    while ((c = getopt(argc, argv, "c:f:hp:")) != -1) {
+    while ((c = getopt_long(argc, argv, "c:C:f:hj:o:p:s:S:v", longOptions, nullptr)) != -1) {
         switch (c) {
+            case 1:
+                bStats = true;
+                break;
+            case 2:
+                cmdTrace = optarg;
+                break;
+            case 3:
+                filter.Include(optarg);
+                break;
+            case 4:
+                filter.Exclude(optarg);
+                break;
+            case 5:
+                cmdHints = optarg;
+                break;
             case 'c':
                 cmdConfig = optarg;
                 break;
+            case 'C':
+                cmdCore = optarg;
+                break;
             case 'f':
                 cmdFormat = optarg;
                 break;
             case 'h':
                 PrintHelpAll();
                 exit(0);
+            case 'j':
+                threads = strtoul(optarg, nullptr, 0);
+                break;
+            case 'o':
+                cmdOutput = optarg;
+                break;
             case 'p':
                 cmdProcess = optarg;
                 break;
+            case 's':
+                cmdSocket = optarg;
+                break;
+            case 'S':
+                cmdSnapshot = optarg;
+                break;
+            case 'v':
+                verbosity++;
+                break;
             case '?':
-                if (optopt == 'c' || optopt == 'f') {
+                if (strchr("cCfjopsS", optopt)) {
                     Logger::Warn("Option -{} requires an argument.", optopt);
                 } else {
                     Logger::Warn("Unknown option '-{}'", optopt);
@@ -179,6 +234,20 @@ int main(int argc, char* argv[])
         }
     }
 
+    if (verbosity) {
+        Logger::SetLevel(verbosity > 1 ? Logger::Level_Trace : Logger::Level_Debug);
+    }
+
+    Context ctx;
+    ctx.SetThreads(threads);
+    ctx.GetFilter() = filter;
+    if (cmdHints && !ctx.GetHints().Load(cmdHints)) {
+        Logger::Debug("No usable hints in \"{}\"", cmdHints);
+    }
+    if (bStats || cmdTrace) {
+        ctx.GetStats().Enable();
+    }
+
     if (argc - optind == 1) {
         cmdTool = argv[optind];
     } else if (optind != argc) {
@@ -186,7 +255,7 @@ int main(int argc, char* argv[])
         return 2;
     }
 
-    if (!ReadSignatureConfig(cmdConfig)) {
+    if (!ctx.LoadConfig(cmdConfig)) {
         Logger::Error("Failed to read signatures config file \"{}\"", cmdConfig);
         return 3;
     }
@@ -197,15 +266,38 @@ int main(int argc, char* argv[])
         return 5;
     }
 
-    if (!g_process.Attach(cmdProcess)) {
-        Logger::Error("Failed to find process \"{}\"", cmdProcess);
-        Logger::Error("Please ensure the process is running");
-        return 6;
-    }
+    ProcessSource process;
+    SnapshotSource snapshot;
+    CoreSource core;
+    if (cmdCore) {
+        if (!core.Load(cmdCore)) {
+            Logger::Error("Failed to load core file \"{}\"", cmdCore);
+            return 6;
+        }
+        ctx.SetMemory(&core);
+    } else if (cmdSnapshot) {
+        if (!snapshot.Load(cmdSnapshot)) {
+            Logger::Error("Failed to load snapshot \"{}\"", cmdSnapshot);
+            return 6;
+        }
+        ctx.SetMemory(&snapshot);
+    } else {
+        if (getuid() != 0) {
+            Logger::Error("This software requires root privileges to run.");
+            return 1;
+        }
+
+        ctx.SetMemory(&process);
+        if (!process.Attach(cmdProcess)) {
+            Logger::Error("Failed to find process \"{}\"", cmdProcess);
+            Logger::Error("Please ensure the process is running");
+            return 6;
+        }
 
-    if (!g_process.ParseMaps()) {
-        Logger::Error("Failed to parse maps file");
-        return 7;
+        if (!process.ParseMaps()) {
+            Logger::Error("Failed to parse maps file");
+            return 7;
+        }
     }
 
     Formatter fmt;
@@ -218,10 +310,27 @@ int main(int argc, char* argv[])
     Logger::Log("Options:");
     PrintOption("Config:", cmdConfig);
     PrintOption("Format:", cmdFormat);
-    PrintOption("Process:", cmdProcess);
+    if (cmdCore) {
+        PrintOption("Core:", cmdCore);
+    } else if (cmdSnapshot) {
+        PrintOption("Snapshot:", cmdSnapshot);
+    } else {
+        PrintOption("Process:", cmdProcess);
+    }
     PrintOption("Tool:", cmdTool);
 
-    RunTool(cmdTool, fmt);
+    bool bSuccess = RunTool(cmdTool, ctx, fmt, cmdSocket, cmdOutput);
+
+    if (cmdHints && ctx.GetHints().IsDirty() && !ctx.GetHints().Save(cmdHints)) {
+        Logger::Error("Failed to write hints \"{}\"", cmdHints);
+    }
+
+    if (bStats) {
+        ctx.GetStats().PrintSummary();
+    }
+    if (cmdTrace && !ctx.GetStats().WriteTrace(cmdTrace)) {
+        Logger::Error("Failed to write trace \"{}\"", cmdTrace);
+    }
 
-    return 0;
+    return bSuccess ? 0 : 9;
 }
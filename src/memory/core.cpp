@@ -0,0 +1,316 @@
+#include "core.h"
+#include "../logger.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <elf.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const size_t CORE_PAGE_SIZE = 4096;
+
+struct FileNote {
+    uint64_t start;
+    uint64_t end;
+    uint64_t offset;
+    std::string path;
+};
+
+static bool MapReadOnly(const char* path, const uint8_t*& data, size_t& size)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+        close(fd);
+        return false;
+    }
+    void* mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        return false;
+    }
+    data = static_cast<const uint8_t*>(mapped);
+    size = st.st_size;
+    return true;
+}
+
+/**
+ * The ELF types of a 64-bit and of a 32-bit core.  Word is the width of
+ * the fields of the NT_FILE note, a long of the dumped process.
+ */
+struct Core64 {
+    typedef Elf64_Ehdr Ehdr;
+    typedef Elf64_Phdr Phdr;
+    typedef Elf64_Nhdr Nhdr;
+    typedef uint64_t Word;
+};
+
+struct Core32 {
+    typedef Elf32_Ehdr Ehdr;
+    typedef Elf32_Phdr Phdr;
+    typedef Elf32_Nhdr Nhdr;
+    typedef uint32_t Word;
+};
+
+template<typename Word>
+static void ParseFileNote(const uint8_t* desc, size_t size, std::vector<FileNote>& out)
+{
+    if (size < 2 * sizeof(Word)) {
+        return;
+    }
+    const Word* header = reinterpret_cast<const Word*>(desc);
+    uint64_t count = header[0];
+    uint64_t pageSize = header[1];
+    if (count > size / sizeof(Word) || size < (2 + count * 3) * sizeof(Word)) {
+        return;
+    }
+
+    const Word* ranges = header + 2;
+    const char* names = reinterpret_cast<const char*>(ranges + count * 3);
+    const char* namesEnd = reinterpret_cast<const char*>(desc + size);
+    for (uint64_t i = 0; i < count && names < namesEnd; ++i) {
+        size_t length = strnlen(names, namesEnd - names);
+        out.push_back({ranges[i * 3], ranges[i * 3 + 1], static_cast<uint64_t>(ranges[i * 3 + 2]) * pageSize,
+                std::string(names, length)});
+        names += length + 1;
+    }
+}
+
+CoreSource::~CoreSource()
+{
+    for (auto& file : m_files) {
+        if (file.second.data) {
+            munmap(const_cast<uint8_t*>(file.second.data), file.second.size);
+        }
+    }
+    if (m_core.data) {
+        munmap(const_cast<uint8_t*>(m_core.data), m_core.size);
+    }
+}
+
+const CoreSource::Mapping* CoreSource::MapFile(const std::string& path)
+{
+    auto it = m_files.find(path);
+    if (it == m_files.end()) {
+        Mapping mapping = {nullptr, 0};
+        MapReadOnly(path.c_str(), mapping.data, mapping.size);
+        it = m_files.insert({path, mapping}).first;
+    }
+    return it->second.data ? &it->second : nullptr;
+}
+
+bool CoreSource::Load(const char* path)
+{
+    if (!MapReadOnly(path, m_core.data, m_core.size) || m_core.size < EI_NIDENT
+            || memcmp(m_core.data, ELFMAG, SELFMAG)) {
+        return false;
+    }
+    switch (m_core.data[EI_CLASS]) {
+        case ELFCLASS64:
+            return LoadCore<Core64>();
+        case ELFCLASS32:
+            return LoadCore<Core32>();
+        default:
+            return false;
+    }
+}
+
+template<typename Elf>
+bool CoreSource::LoadCore()
+{
+    typedef typename Elf::Phdr Phdr;
+    typedef typename Elf::Nhdr Nhdr;
+    const typename Elf::Ehdr* ehdr = reinterpret_cast<const typename Elf::Ehdr*>(m_core.data);
+    if (m_core.size < sizeof(*ehdr) || ehdr->e_type != ET_CORE || ehdr->e_phentsize != sizeof(Phdr)
+            || ehdr->e_phoff > m_core.size || ehdr->e_phnum > (m_core.size - ehdr->e_phoff) / sizeof(Phdr)) {
+        return false;
+    }
+
+    const Phdr* phdrs = reinterpret_cast<const Phdr*>(m_core.data + ehdr->e_phoff);
+    std::vector<const Phdr*> loads;
+    std::vector<FileNote> files;
+    for (int i = 0; i < ehdr->e_phnum; ++i) {
+        const Phdr& phdr = phdrs[i];
+        if (phdr.p_offset > m_core.size || phdr.p_filesz > m_core.size - phdr.p_offset) {
+            continue;
+        }
+        if (phdr.p_type == PT_LOAD) {
+            loads.push_back(&phdr);
+        } else if (phdr.p_type == PT_NOTE) {
+            const uint8_t* note = m_core.data + phdr.p_offset;
+            const uint8_t* end = note + phdr.p_filesz;
+            while (note + sizeof(Nhdr) <= end) {
+                const Nhdr* nhdr = reinterpret_cast<const Nhdr*>(note);
+                const uint8_t* desc = note + sizeof(Nhdr) + ((nhdr->n_namesz + 3) & ~3u);
+                if (desc > end || nhdr->n_descsz > static_cast<size_t>(end - desc)) {
+                    break;
+                }
+                if (nhdr->n_type == NT_FILE) {
+                    ParseFileNote<typename Elf::Word>(desc, nhdr->n_descsz, files);
+                }
+                note = desc + ((nhdr->n_descsz + 3) & ~3u);
+            }
+        }
+    }
+
+    std::sort(loads.begin(), loads.end(),
+            [](const Phdr* a, const Phdr* b) { return a->p_vaddr < b->p_vaddr; });
+    std::sort(files.begin(), files.end(),
+            [](const FileNote& a, const FileNote& b) { return a.start < b.start; });
+
+    // Split the load segments wherever the file mappings begin or end
+    std::vector<Region> regions;
+    for (const Phdr* load : loads) {
+        uintptr_t loadEnd = load->p_vaddr + load->p_memsz;
+        uintptr_t cursor = load->p_vaddr;
+        auto file = std::lower_bound(files.begin(), files.end(), cursor,
+                [](const FileNote& note, uintptr_t addr) { return note.end <= addr; });
+        while (cursor < loadEnd) {
+            Region region;
+            region.start = cursor;
+            region.offset = 0;
+            region.perms = (load->p_flags & PF_R ? PROT_READ : 0)
+                | (load->p_flags & PF_W ? PROT_WRITE : 0)
+                | (load->p_flags & PF_X ? PROT_EXEC : 0);
+            if (file != files.end() && file->start <= cursor) {
+                region.end = std::min(loadEnd, static_cast<uintptr_t>(file->end));
+                region.offset = file->offset + (cursor - file->start);
+                region.path = file->path.c_str();
+                if (region.end == file->end) {
+                    ++file;
+                }
+            } else {
+                region.end = file != files.end() ? std::min(loadEnd, static_cast<uintptr_t>(file->start)) : loadEnd;
+            }
+
+            Segment segment;
+            segment.start = region.start;
+            segment.end = region.end;
+            uintptr_t fileEnd = load->p_vaddr + load->p_filesz;
+            segment.data = m_core.data + load->p_offset + (region.start - load->p_vaddr);
+            segment.dataSize = fileEnd > region.start ? std::min(fileEnd, region.end) - region.start : 0;
+            segment.file = nullptr;
+            segment.fileSize = 0;
+            segment.bFileBacked = *region.path != '\0';
+
+            m_segments.push_back(segment);
+            regions.push_back(region);
+            cursor = region.end;
+        }
+    }
+
+    AttachFiles(regions);
+    SetRegions(regions);
+    return !m_segments.empty();
+}
+
+/**
+ * The first page of a mapping at file offset 0 is the ELF header, which
+ * the kernel keeps in the core even when it leaves the rest out.  A file
+ * whose first page differs is another build than the one dumped.
+ */
+bool CoreSource::MatchesFile(const std::vector<Region>& regions, const char* path, const Mapping& mapping) const
+{
+    for (size_t i = 0; i < regions.size(); ++i) {
+        const Segment& segment = m_segments[i];
+        if (regions[i].offset || strcmp(regions[i].path, path)) {
+            continue;
+        }
+        size_t size = std::min(std::min(segment.dataSize, mapping.size), CORE_PAGE_SIZE);
+        if (size && !memcmp(segment.data, mapping.data, size)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Backs the pages the core left out of file mappings with the mapped file,
+ * as long as it is the file the process had mapped.
+ */
+void CoreSource::AttachFiles(const std::vector<Region>& regions)
+{
+    std::map<std::string, bool> matches;
+    for (size_t i = 0; i < regions.size(); ++i) {
+        Segment& segment = m_segments[i];
+        const Region& region = regions[i];
+        if (segment.dataSize >= region.GetSize() || !segment.bFileBacked) {
+            continue;
+        }
+        const Mapping* mapping = MapFile(region.path);
+        if (!mapping || mapping->size <= region.offset) {
+            continue;
+        }
+        auto match = matches.find(region.path);
+        if (match == matches.end()) {
+            match = matches.insert({region.path, MatchesFile(regions, region.path, *mapping)}).first;
+            if (!match->second) {
+                Logger::Debug("{}: does not match the core, its missing pages stay unreadable", region.path);
+            }
+        }
+        if (match->second) {
+            segment.file = mapping->data + region.offset;
+            segment.fileSize = std::min(static_cast<size_t>(mapping->size - region.offset), region.GetSize());
+        }
+    }
+}
+
+const CoreSource::Segment* CoreSource::FindSegment(uintptr_t address) const
+{
+    auto it = std::upper_bound(m_segments.begin(), m_segments.end(), address,
+            [](uintptr_t addr, const Segment& segment) { return addr < segment.start; });
+    if (it == m_segments.begin() || address >= (it - 1)->end) {
+        return nullptr;
+    }
+    return &*(it - 1);
+}
+
+ssize_t CoreSource::ReadMemory(uintptr_t address, void* buffer, size_t size)
+{
+    uint8_t* out = static_cast<uint8_t*>(buffer);
+    size_t done = 0;
+    while (done < size) {
+        const Segment* segment = FindSegment(address + done);
+        if (!segment) {
+            break;
+        }
+        size_t rel = address + done - segment->start;
+        size_t available = std::min(size - done, static_cast<size_t>(segment->end - segment->start) - rel);
+        if (rel < segment->dataSize) {
+            available = std::min(available, segment->dataSize - rel);
+            memcpy(out + done, segment->data + rel, available);
+        } else if (rel < segment->fileSize) {
+            available = std::min(available, segment->fileSize - rel);
+            memcpy(out + done, segment->file + rel, available);
+        } else if (segment->bFileBacked) {
+            // Left out of the core and not available from the file
+            break;
+        } else {
+            memset(out + done, 0, available);
+        }
+        done += available;
+    }
+    CountRead(done);
+    return done ? static_cast<ssize_t>(done) : -1;
+}
+
+const uint8_t* CoreSource::GetView(uintptr_t address, size_t size)
+{
+    const Segment* segment = FindSegment(address);
+    if (!segment) {
+        return nullptr;
+    }
+    size_t rel = address - segment->start;
+    if (rel + size <= segment->dataSize) {
+        return segment->data + rel;
+    }
+    if (rel >= segment->dataSize && rel + size <= segment->fileSize) {
+        return segment->file + rel;
+    }
+    return nullptr;
+}
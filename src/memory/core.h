@@ -0,0 +1,48 @@
+#ifndef  __TUXDUMP_MEMORY_CORE_H__
+#define  __TUXDUMP_MEMORY_CORE_H__
+#include "source.h"
+
+#include <map>
+
+/**
+ * Serves reads from an ELF core file such as one written by gcore.  The
+ * PT_LOAD segments provide the memory and the NT_FILE note names the
+ * mappings.  Pages the core left out of file backed mappings are read from
+ * the mapped file itself when it is still available and still the file the
+ * process had mapped.  Cores of 64-bit and 32-bit processes are read.
+ */
+class CoreSource : public MemorySource {
+    public:
+        ~CoreSource();
+        bool Load(const char* path);
+
+        ssize_t ReadMemory(uintptr_t address, void* buffer, size_t size) override;
+        const uint8_t* GetView(uintptr_t address, size_t size) override;
+    private:
+        struct Segment {
+            uintptr_t start;
+            uintptr_t end;
+            const uint8_t* data;
+            size_t dataSize;
+            const uint8_t* file;
+            size_t fileSize;
+            bool bFileBacked;
+        };
+        struct Mapping {
+            const uint8_t* data;
+            size_t size;
+        };
+    private:
+        const Segment* FindSegment(uintptr_t address) const;
+        const Mapping* MapFile(const std::string& path);
+        template<typename Elf>
+        bool LoadCore();
+        void AttachFiles(const std::vector<Region>& regions);
+        bool MatchesFile(const std::vector<Region>& regions, const char* path, const Mapping& mapping) const;
+    private:
+        Mapping m_core = {nullptr, 0};
+        std::map<std::string, Mapping> m_files;
+        std::vector<Segment> m_segments;
+};
+
+#endif //__TUXDUMP_MEMORY_CORE_H__
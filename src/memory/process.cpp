@@ -0,0 +1,236 @@
+#include "process.h"
+#include "../logger.h"
+#include "../stats.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+bool ProcessSource::Attach(const char* processName)
+{
+    ScopedPhase phase(GetStats(), "Attach", processName);
+    DIR* proc = opendir("/proc");
+    if (!proc) {
+        return false;
+    }
+
+    // comm is truncated to 15 characters by the kernel
+    size_t nameLength = std::min(strlen(processName), static_cast<size_t>(15));
+    pid_t found = -1;
+    while (dirent* entry = readdir(proc)) {
+        char* end;
+        long pid = strtol(entry->d_name, &end, 10);
+        if (*end || pid <= 0) {
+            continue;
+        }
+
+        char path[64];
+        char comm[32] = {};
+        snprintf(path, sizeof(path), "/proc/%ld/comm", pid);
+        FILE* file = fopen(path, "r");
+        if (!file) {
+            continue;
+        }
+        bool bRead = fgets(comm, sizeof(comm), file) != nullptr;
+        fclose(file);
+        if (!bRead) {
+            continue;
+        }
+        comm[strcspn(comm, "\n")] = '\0';
+        if (strlen(comm) == nameLength && !strncmp(comm, processName, nameLength)) {
+            found = static_cast<pid_t>(pid);
+            break;
+        }
+    }
+    closedir(proc);
+    m_name = processName;
+    return found != -1 && Attach(found);
+}
+
+bool ProcessSource::Attach(pid_t pid)
+{
+    if (kill(pid, 0) == -1 && errno != EPERM) {
+        return false;
+    }
+    m_pid = pid;
+    Logger::Debug("Attached to pid {}", pid);
+    return true;
+}
+
+/**
+ * A process attached by name is looked up again, so a restarted game is
+ * followed to its new pid.
+ */
+bool ProcessSource::Refresh()
+{
+    bool bAttached = m_name.empty() ? Attach(m_pid) : Attach(m_name.c_str());
+    return bAttached && ParseMaps();
+}
+
+static bool ParseHex(const char*& cursor, const char* end, uint64_t& value)
+{
+    const char* begin = cursor;
+    value = 0;
+    for (; cursor < end; ++cursor) {
+        char c = *cursor;
+        if (c >= '0' && c <= '9') {
+            value = value << 4 | (c - '0');
+        } else if (c >= 'a' && c <= 'f') {
+            value = value << 4 | (c - 'a' + 10);
+        } else {
+            break;
+        }
+    }
+    return cursor != begin;
+}
+
+static const char* SkipField(const char* cursor, const char* end)
+{
+    while (cursor < end && *cursor != ' ') {
+        cursor++;
+    }
+    while (cursor < end && *cursor == ' ') {
+        cursor++;
+    }
+    return cursor;
+}
+
+/**
+ * Parses "start-end perms offset dev inode path" in place; the path is
+ * terminated inside the line buffer.
+ */
+static bool ParseMapsLine(char* line, char* end, Region& region)
+{
+    const char* cursor = line;
+    uint64_t start, stop, offset;
+    if (!ParseHex(cursor, end, start) || cursor == end || *cursor++ != '-'
+            || !ParseHex(cursor, end, stop) || end - cursor < 6 || *cursor++ != ' ') {
+        return false;
+    }
+    region.start = start;
+    region.end = stop;
+    region.perms = (cursor[0] == 'r' ? PROT_READ : 0)
+        | (cursor[1] == 'w' ? PROT_WRITE : 0)
+        | (cursor[2] == 'x' ? PROT_EXEC : 0);
+    cursor = SkipField(cursor, end);
+    if (!ParseHex(cursor, end, offset)) {
+        return false;
+    }
+    region.offset = offset;
+    cursor = SkipField(cursor, end);
+    cursor = SkipField(cursor, end);
+    cursor = SkipField(cursor, end);
+
+    char* pathEnd = end;
+    while (pathEnd > cursor && pathEnd[-1] == ' ') {
+        pathEnd--;
+    }
+    *pathEnd = '\0';
+    region.path = cursor;
+    return true;
+}
+
+bool ProcessSource::ParseMaps()
+{
+    ScopedPhase phase(GetStats(), "ParseMaps");
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/maps", m_pid);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+
+    // Slurp the file in one go, the buffers are kept for the next refresh
+    if (m_maps.size() < 64 * 1024) {
+        m_maps.resize(64 * 1024);
+    }
+    size_t size = 0;
+    for (;;) {
+        if (size == m_maps.size()) {
+            m_maps.resize(m_maps.size() * 2);
+        }
+        ssize_t nread = read(fd, &m_maps[size], m_maps.size() - size);
+        if (nread < 0 && errno == EINTR) {
+            continue;
+        }
+        if (nread <= 0) {
+            break;
+        }
+        size += nread;
+    }
+    close(fd);
+
+    m_parsed.clear();
+    char* cursor = m_maps.data();
+    char* end = cursor + size;
+    while (cursor < end) {
+        char* lineEnd = static_cast<char*>(memchr(cursor, '\n', end - cursor));
+        if (!lineEnd) {
+            lineEnd = end;
+        }
+        Region region;
+        if (ParseMapsLine(cursor, lineEnd, region)) {
+            m_parsed.push_back(region);
+        }
+        cursor = lineEnd + 1;
+    }
+
+    SetRegions(m_parsed);
+    Logger::Debug("Parsed {} regions, {} modules from {}", GetRegions().size(), GetModules().size(), path);
+    return !GetRegions().empty();
+}
+
+ssize_t ProcessSource::ReadMemory(uintptr_t address, void* buffer, size_t size)
+{
+    iovec local = {buffer, size};
+    iovec remote = {reinterpret_cast<void*>(address), size};
+    ssize_t result = process_vm_readv(m_pid, &local, 1, &remote, 1, 0);
+    CountRead(result, true);
+    return result;
+}
+
+size_t ProcessSource::ReadMemoryV(ReadOp* ops, size_t count)
+{
+    iovec local[IOV_MAX];
+    iovec remote[IOV_MAX];
+    size_t complete = 0;
+    size_t i = 0;
+    while (i < count) {
+        size_t batch = std::min(count - i, static_cast<size_t>(IOV_MAX));
+        for (size_t j = 0; j < batch; ++j) {
+            local[j] = {ops[i + j].buffer, ops[i + j].size};
+            remote[j] = {reinterpret_cast<void*>(ops[i + j].address), ops[i + j].size};
+        }
+
+        // The kernel stops at the first remote range it cannot read
+        ssize_t nread = process_vm_readv(m_pid, local, batch, remote, batch, 0);
+        CountRead(nread, true);
+        size_t bytes = nread > 0 ? nread : 0;
+        size_t done = 0;
+        while (done < batch && bytes >= ops[i + done].size) {
+            ops[i + done].result = ops[i + done].size;
+            bytes -= ops[i + done].size;
+            done++;
+        }
+        complete += done;
+        i += done;
+
+        if (done < batch) {
+            ReadOp& op = ops[i++];
+            op.result = ReadMemory(op.address, op.buffer, op.size);
+            if (op.result == static_cast<ssize_t>(op.size)) {
+                complete++;
+            }
+        }
+    }
+    return complete;
+}
@@ -0,0 +1,25 @@
+#ifndef  __TUXDUMP_MEMORY_PROCESS_H__
+#define  __TUXDUMP_MEMORY_PROCESS_H__
+#include "source.h"
+
+/**
+ * Reads from a live process through process_vm_readv.
+ */
+class ProcessSource : public MemorySource {
+    public:
+        bool Attach(const char* processName);
+        bool Attach(pid_t pid);
+        bool ParseMaps();
+        bool Refresh() override;
+        pid_t GetPid() const { return m_pid; }
+
+        ssize_t ReadMemory(uintptr_t address, void* buffer, size_t size) override;
+        size_t ReadMemoryV(ReadOp* ops, size_t count) override;
+    private:
+        pid_t m_pid = -1;
+        std::string m_name;
+        std::vector<char> m_maps;
+        std::vector<Region> m_parsed;
+};
+
+#endif //__TUXDUMP_MEMORY_PROCESS_H__
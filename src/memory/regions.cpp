@@ -0,0 +1,84 @@
+#include "regions.h"
+
+#include <algorithm>
+
+size_t RegionIndex::StringHash::operator()(const char* text) const
+{
+    // FNV-1a
+    size_t hash = 14695981039346656037ull;
+    while (*text) {
+        hash = (hash ^ static_cast<uint8_t>(*text++)) * 1099511628211ull;
+    }
+    return hash;
+}
+
+const char* RegionIndex::Intern(const char* text, StringSet& set, std::deque<std::string>& storage)
+{
+    auto it = set.find(text);
+    if (it != set.end()) {
+        return *it;
+    }
+    storage.push_back(text);
+    const char* interned = storage.back().c_str();
+    set.insert(interned);
+    return interned;
+}
+
+void RegionIndex::Assign(const std::vector<Region>& regions)
+{
+    // The input may point into the current string pool, so intern into a
+    // fresh one and swap at the end
+    StringSet strings;
+    std::deque<std::string> storage;
+    std::vector<Region> sorted;
+    sorted.reserve(regions.size());
+    for (const Region& region : regions) {
+        Region copy = region;
+        copy.path = Intern(region.path, strings, storage);
+        const char* slash = strrchr(copy.path, '/');
+        copy.name = slash ? slash + 1 : copy.path;
+        sorted.push_back(copy);
+    }
+    auto byStart = [](const Region& a, const Region& b) { return a.start < b.start; };
+    if (!std::is_sorted(sorted.begin(), sorted.end(), byStart)) {
+        std::sort(sorted.begin(), sorted.end(), byStart);
+    }
+
+    m_regions.swap(sorted);
+    m_strings.swap(strings);
+    m_storage.swap(storage);
+    m_modules.clear();
+    m_lookup.clear();
+
+    // Consecutive mappings of the same file form one module
+    for (const Region& region : m_regions) {
+        if (!*region.path || region.path[0] == '[') {
+            continue;
+        }
+        if (!m_modules.empty() && m_modules.back().path == region.path) {
+            m_modules.back().end = region.end;
+            m_modules.back().perms |= region.perms;
+            continue;
+        }
+        m_modules.push_back(region);
+    }
+    for (size_t i = 0; i < m_modules.size(); ++i) {
+        m_lookup.insert(std::make_pair(m_modules[i].name, i));
+    }
+}
+
+const Region* RegionIndex::FindModule(const char* name) const
+{
+    auto it = m_lookup.find(name);
+    return it != m_lookup.end() ? &m_modules[it->second] : nullptr;
+}
+
+const Region* RegionIndex::Find(uintptr_t address) const
+{
+    auto it = std::upper_bound(m_regions.begin(), m_regions.end(), address,
+            [](uintptr_t addr, const Region& region) { return addr < region.start; });
+    if (it == m_regions.begin() || !(it - 1)->Contains(address)) {
+        return nullptr;
+    }
+    return &*(it - 1);
+}
@@ -0,0 +1,69 @@
+#ifndef  __TUXDUMP_MEMORY_REGIONS_H__
+#define  __TUXDUMP_MEMORY_REGIONS_H__
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <sys/mman.h>
+
+/**
+ * A mapped range of the target's address space.  Permissions use the
+ * PROT_* bits, name is the basename of the backing file (or the raw
+ * pseudo path such as "[heap]").  Both strings are owned by the
+ * RegionIndex the region came from.
+ */
+struct Region {
+    uintptr_t start = 0;
+    uintptr_t end = 0;
+    uint64_t offset = 0;
+    int perms = 0;
+    const char* path = "";
+    const char* name = "";
+
+    uintptr_t GetStartAddress() const { return start; }
+    uintptr_t GetEndAddress() const { return end; }
+    size_t GetSize() const { return end - start; }
+    bool Contains(uintptr_t address) const { return address >= start && address < end; }
+};
+
+/**
+ * Regions sorted by address, plus the modules formed by consecutive
+ * mappings of the same file.  Paths are interned so every mapping of a
+ * file shares one string, modules are hashed by name and addresses are
+ * resolved by binary search.
+ */
+class RegionIndex {
+    public:
+        RegionIndex() = default;
+        RegionIndex(const RegionIndex&) = delete;
+        RegionIndex& operator=(const RegionIndex&) = delete;
+
+        void Assign(const std::vector<Region>& regions);
+        const std::vector<Region>& GetRegions() const { return m_regions; }
+        const std::vector<Region>& GetModules() const { return m_modules; }
+        const Region* FindModule(const char* name) const;
+        const Region* Find(uintptr_t address) const;
+    private:
+        struct StringHash {
+            size_t operator()(const char* text) const;
+        };
+        struct StringEqual {
+            bool operator()(const char* a, const char* b) const { return !strcmp(a, b); }
+        };
+        typedef std::unordered_set<const char*, StringHash, StringEqual> StringSet;
+    private:
+        static const char* Intern(const char* text, StringSet& set, std::deque<std::string>& storage);
+    private:
+        std::vector<Region> m_regions;
+        std::vector<Region> m_modules;
+        std::unordered_map<const char*, size_t, StringHash, StringEqual> m_lookup;
+        StringSet m_strings;
+        std::deque<std::string> m_storage;
+};
+
+#endif //__TUXDUMP_MEMORY_REGIONS_H__
@@ -0,0 +1,304 @@
+#include "snapshot.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static uint64_t AlignPage(uint64_t value)
+{
+    return (value + SNAPSHOT_PAGE_SIZE - 1) & ~(SNAPSHOT_PAGE_SIZE - 1);
+}
+
+static bool IsZeroPage(const uint8_t* page)
+{
+    const uint64_t* words = reinterpret_cast<const uint64_t*>(page);
+    uint64_t acc = 0;
+    for (size_t i = 0; i < SNAPSHOT_PAGE_SIZE / sizeof(uint64_t); ++i) {
+        acc |= words[i];
+    }
+    return !acc;
+}
+
+static bool WriteAll(int fd, const void* data, size_t size, uint64_t offset)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    while (size > 0) {
+        ssize_t written = pwrite(fd, bytes, size, offset);
+        if (written <= 0) {
+            return false;
+        }
+        bytes += written;
+        size -= written;
+        offset += written;
+    }
+    return true;
+}
+
+bool WriteSnapshot(MemorySource& mem, const std::vector<Region>& regions, const char* path)
+{
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        return false;
+    }
+
+    std::vector<Region> sorted(regions);
+    std::sort(sorted.begin(), sorted.end(),
+            [](const Region& a, const Region& b) { return a.start < b.start; });
+
+    std::vector<SnapshotRegion> index;
+    std::vector<SnapshotExtent> extents;
+    std::string strings;
+    std::vector<uint8_t> chunk(256 * SNAPSHOT_PAGE_SIZE);
+    uint64_t dataEnd = SNAPSHOT_PAGE_SIZE;
+    bool bOk = true;
+
+    for (const Region& region : sorted) {
+        SnapshotRegion entry;
+        entry.start = region.start;
+        entry.end = region.end;
+        entry.offset = region.offset;
+        entry.perms = region.perms;
+        entry.pathOffset = strings.size();
+        entry.pathLength = strlen(region.path);
+        entry.firstExtent = extents.size();
+        strings += region.path;
+        index.push_back(entry);
+
+        for (uintptr_t address = region.start; bOk && address < region.end; address += chunk.size()) {
+            size_t size = std::min(static_cast<size_t>(region.end - address), chunk.size());
+            size_t pages = size / SNAPSHOT_PAGE_SIZE;
+            std::vector<bool> readable(pages, true);
+            if (mem.ReadMemory(address, chunk.data(), size) != static_cast<ssize_t>(size)) {
+                for (size_t i = 0; i < pages; ++i) {
+                    readable[i] = mem.ReadMemory(address + i * SNAPSHOT_PAGE_SIZE,
+                            &chunk[i * SNAPSHOT_PAGE_SIZE], SNAPSHOT_PAGE_SIZE) == static_cast<ssize_t>(SNAPSHOT_PAGE_SIZE);
+                }
+            }
+
+            for (size_t i = 0; i < pages; ++i) {
+                if (!readable[i]) {
+                    continue;
+                }
+                uintptr_t page = address + i * SNAPSHOT_PAGE_SIZE;
+                bool bZero = IsZeroPage(&chunk[i * SNAPSHOT_PAGE_SIZE]);
+                SnapshotExtent* last = extents.size() > entry.firstExtent ? &extents.back() : nullptr;
+                if (last && last->end == page && (last->dataOffset == 0) == bZero) {
+                    last->end += SNAPSHOT_PAGE_SIZE;
+                } else {
+                    extents.push_back({page, page + SNAPSHOT_PAGE_SIZE, bZero ? 0 : dataEnd});
+                }
+                if (!bZero) {
+                    bOk = WriteAll(fd, &chunk[i * SNAPSHOT_PAGE_SIZE], SNAPSHOT_PAGE_SIZE, dataEnd);
+                    dataEnd += SNAPSHOT_PAGE_SIZE;
+                }
+            }
+        }
+    }
+
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.pageSize = SNAPSHOT_PAGE_SIZE;
+    header.regionCount = index.size();
+    header.regionOffset = AlignPage(dataEnd);
+    header.extentCount = extents.size();
+    header.extentOffset = header.regionOffset + index.size() * sizeof(SnapshotRegion);
+    header.stringOffset = header.extentOffset + extents.size() * sizeof(SnapshotExtent);
+    header.stringSize = strings.size();
+
+    bOk = bOk
+        && WriteAll(fd, index.data(), index.size() * sizeof(SnapshotRegion), header.regionOffset)
+        && WriteAll(fd, extents.data(), extents.size() * sizeof(SnapshotExtent), header.extentOffset)
+        && WriteAll(fd, strings.data(), strings.size(), header.stringOffset)
+        && WriteAll(fd, &header, sizeof(header), 0);
+    close(fd);
+    return bOk;
+}
+
+/** True if size bytes at offset fit into limit, without overflowing */
+static bool Fits(uint64_t offset, uint64_t size, uint64_t limit)
+{
+    return offset <= limit && size <= limit - offset;
+}
+
+static bool FitsArray(uint64_t offset, uint64_t count, uint64_t size, uint64_t limit)
+{
+    return count <= limit / size && Fits(offset, count * size, limit) && offset % alignof(uint64_t) == 0;
+}
+
+/**
+ * Regions have to be sorted and disjoint, and each owns the extents from
+ * its firstExtent up to the next region's, which have to be sorted,
+ * disjoint and inside it with their data inside the file.  Reads trust
+ * the tables after this.
+ */
+static bool CheckIndex(const SnapshotHeader& header, const SnapshotRegion* index,
+        const SnapshotExtent* extents, uint64_t fileSize)
+{
+    if (header.regionCount ? index[0].firstExtent != 0 : header.extentCount != 0) {
+        return false;
+    }
+    for (uint64_t i = 0; i < header.regionCount; ++i) {
+        const SnapshotRegion& region = index[i];
+        uint64_t lastExtent = i + 1 < header.regionCount ? index[i + 1].firstExtent : header.extentCount;
+        if (region.start >= region.end || (i && region.start < index[i - 1].end)
+                || !Fits(region.pathOffset, region.pathLength, header.stringSize)
+                || region.firstExtent > lastExtent || lastExtent > header.extentCount) {
+            return false;
+        }
+        for (uint64_t j = region.firstExtent; j < lastExtent; ++j) {
+            const SnapshotExtent& extent = extents[j];
+            if (extent.start >= extent.end || extent.start < region.start || extent.end > region.end
+                    || (j > region.firstExtent && extent.start < extents[j - 1].end)
+                    || (extent.dataOffset && !Fits(extent.dataOffset, extent.end - extent.start, fileSize))) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+SnapshotSource::~SnapshotSource()
+{
+    if (m_data) {
+        munmap(const_cast<uint8_t*>(m_data), m_size);
+    }
+}
+
+bool SnapshotSource::Load(const char* path)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1 || static_cast<size_t>(st.st_size) < sizeof(SnapshotHeader)) {
+        close(fd);
+        return false;
+    }
+    void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+    m_data = static_cast<const uint8_t*>(data);
+    m_size = st.st_size;
+
+    const SnapshotHeader* header = reinterpret_cast<const SnapshotHeader*>(m_data);
+    if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic))
+            || header->version != SNAPSHOT_VERSION
+            || header->pageSize != SNAPSHOT_PAGE_SIZE
+            || !Fits(header->stringOffset, header->stringSize, m_size)
+            || !FitsArray(header->regionOffset, header->regionCount, sizeof(SnapshotRegion), m_size)
+            || !FitsArray(header->extentOffset, header->extentCount, sizeof(SnapshotExtent), m_size)) {
+        return false;
+    }
+
+    const SnapshotRegion* index = reinterpret_cast<const SnapshotRegion*>(m_data + header->regionOffset);
+    const SnapshotExtent* extents = reinterpret_cast<const SnapshotExtent*>(m_data + header->extentOffset);
+    if (!CheckIndex(*header, index, extents, m_size)) {
+        return false;
+    }
+    m_extents = extents;
+    m_extentCount = header->extentCount;
+
+    const char* strings = reinterpret_cast<const char*>(m_data + header->stringOffset);
+    std::vector<Region> regions;
+    std::vector<std::string> paths;
+    regions.reserve(header->regionCount);
+    paths.reserve(header->regionCount);
+    for (size_t i = 0; i < header->regionCount; ++i) {
+        Region region;
+        region.start = index[i].start;
+        region.end = index[i].end;
+        region.offset = index[i].offset;
+        region.perms = index[i].perms;
+        paths.emplace_back(strings + index[i].pathOffset, index[i].pathLength);
+        region.path = paths.back().c_str();
+        regions.push_back(region);
+    }
+    SetRegions(regions);
+    return true;
+}
+
+const SnapshotExtent* SnapshotSource::FindExtent(uintptr_t address) const
+{
+    const SnapshotExtent* end = m_extents + m_extentCount;
+    const SnapshotExtent* it = std::upper_bound(m_extents, end, address,
+            [](uintptr_t addr, const SnapshotExtent& extent) { return addr < extent.start; });
+    if (it == m_extents || address >= (it - 1)->end) {
+        return nullptr;
+    }
+    return it - 1;
+}
+
+ssize_t SnapshotSource::ReadMemory(uintptr_t address, void* buffer, size_t size)
+{
+    uint8_t* out = static_cast<uint8_t*>(buffer);
+    size_t done = 0;
+    while (done < size) {
+        const SnapshotExtent* extent = FindExtent(address + done);
+        if (!extent) {
+            break;
+        }
+        size_t available = std::min(size - done, static_cast<size_t>(extent->end - (address + done)));
+        if (extent->dataOffset) {
+            memcpy(out + done, m_data + extent->dataOffset + (address + done - extent->start), available);
+        } else {
+            memset(out + done, 0, available);
+        }
+        done += available;
+    }
+    CountRead(done);
+    return done ? static_cast<ssize_t>(done) : -1;
+}
+
+const uint8_t* SnapshotSource::GetView(uintptr_t address, size_t size)
+{
+    const SnapshotExtent* extent = FindExtent(address);
+    if (!extent || !extent->dataOffset || address + size > extent->end) {
+        return nullptr;
+    }
+    return m_data + extent->dataOffset + (address - extent->start);
+}
+
+RecordingSource::RecordingSource(MemorySource& mem) : m_mem(mem)
+{
+    SetRegions(mem.GetRegions());
+}
+
+void RecordingSource::Record(uintptr_t address, size_t size)
+{
+    if (!size) {
+        return;
+    }
+    uintptr_t last = (address + size - 1) & ~(SNAPSHOT_PAGE_SIZE - 1);
+    for (uintptr_t page = address & ~(SNAPSHOT_PAGE_SIZE - 1); page <= last; page += SNAPSHOT_PAGE_SIZE) {
+        m_pages.insert(page);
+    }
+}
+
+ssize_t RecordingSource::ReadMemory(uintptr_t address, void* buffer, size_t size)
+{
+    ssize_t result = m_mem.ReadMemory(address, buffer, size);
+    if (result > 0) {
+        Record(address, result);
+    }
+    return result;
+}
+
+size_t RecordingSource::ReadMemoryV(ReadOp* ops, size_t count)
+{
+    size_t complete = m_mem.ReadMemoryV(ops, count);
+    for (size_t i = 0; i < count; ++i) {
+        if (ops[i].result > 0) {
+            Record(ops[i].address, ops[i].result);
+        }
+    }
+    return complete;
+}
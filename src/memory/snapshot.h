@@ -0,0 +1,92 @@
+#ifndef  __TUXDUMP_MEMORY_SNAPSHOT_H__
+#define  __TUXDUMP_MEMORY_SNAPSHOT_H__
+#include "source.h"
+
+#include <set>
+
+/**
+ * Snapshot file layout, all offsets in bytes from the start of the file:
+ *
+ *     SnapshotHeader                   first page
+ *     page data                        page aligned
+ *     SnapshotRegion[regionCount]      page aligned, sorted by address
+ *     SnapshotExtent[extentCount]      sorted by address
+ *     path strings
+ *
+ * Every region is split into extents, its own running from firstExtent to
+ * the next region's firstExtent.  Runs of all-zero pages are stored as
+ * extents without data (dataOffset == 0), everything else is stored once
+ * and can be used straight out of the mapped file.
+ */
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t pageSize;
+    uint64_t regionCount;
+    uint64_t regionOffset;
+    uint64_t extentCount;
+    uint64_t extentOffset;
+    uint64_t stringOffset;
+    uint64_t stringSize;
+};
+
+struct SnapshotRegion {
+    uint64_t start;
+    uint64_t end;
+    uint64_t offset;
+    uint32_t perms;
+    uint32_t pathOffset;
+    uint32_t pathLength;
+    uint32_t firstExtent;
+};
+
+struct SnapshotExtent {
+    uint64_t start;
+    uint64_t end;
+    uint64_t dataOffset;
+};
+
+constexpr char SNAPSHOT_MAGIC[8] = {'T', 'U', 'X', 'S', 'N', 'A', 'P', '\0'};
+constexpr uint32_t SNAPSHOT_VERSION = 1;
+constexpr uint64_t SNAPSHOT_PAGE_SIZE = 4096;
+
+/**
+ * Serves reads from a memory mapped snapshot file.
+ */
+class SnapshotSource : public MemorySource {
+    public:
+        ~SnapshotSource();
+        bool Load(const char* path);
+
+        ssize_t ReadMemory(uintptr_t address, void* buffer, size_t size) override;
+        const uint8_t* GetView(uintptr_t address, size_t size) override;
+    private:
+        const SnapshotExtent* FindExtent(uintptr_t address) const;
+    private:
+        const uint8_t* m_data = nullptr;
+        size_t m_size = 0;
+        const SnapshotExtent* m_extents = nullptr;
+        size_t m_extentCount = 0;
+};
+
+/**
+ * Forwards to another source and remembers every page that was read, so a
+ * snapshot can include the heap pages a dump actually touched.
+ */
+class RecordingSource : public MemorySource {
+    public:
+        explicit RecordingSource(MemorySource& mem);
+        const std::set<uintptr_t>& GetPages() const { return m_pages; }
+
+        ssize_t ReadMemory(uintptr_t address, void* buffer, size_t size) override;
+        size_t ReadMemoryV(ReadOp* ops, size_t count) override;
+    private:
+        void Record(uintptr_t address, size_t size);
+    private:
+        MemorySource& m_mem;
+        std::set<uintptr_t> m_pages;
+};
+
+bool WriteSnapshot(MemorySource& mem, const std::vector<Region>& regions, const char* path);
+
+#endif //__TUXDUMP_MEMORY_SNAPSHOT_H__
@@ -0,0 +1,108 @@
+#include "source.h"
+#include "../stats.h"
+
+#include <algorithm>
+#include <cstring>
+
+size_t MemorySource::ReadMemoryV(ReadOp* ops, size_t count)
+{
+    size_t complete = 0;
+    for (size_t i = 0; i < count; ++i) {
+        ops[i].result = ReadMemory(ops[i].address, ops[i].buffer, ops[i].size);
+        if (ops[i].result == static_cast<ssize_t>(ops[i].size)) {
+            complete++;
+        }
+    }
+    return complete;
+}
+
+const uint8_t* MemorySource::GetView(uintptr_t, size_t)
+{
+    return nullptr;
+}
+
+size_t MemorySource::GetReadableSize(uintptr_t address, size_t size) const
+{
+    // Walk forward while the following regions are readable and adjacent
+    const Region* region = FindRegion(address);
+    const Region* last = GetRegions().data() + GetRegions().size();
+    size_t available = 0;
+    while (region && (region->perms & PROT_READ) && available < size) {
+        available = region->end - address;
+        if (++region == last || region->start != (region - 1)->end) {
+            break;
+        }
+    }
+    return std::min(available, size);
+}
+
+bool MemorySource::ReadChecked(uintptr_t address, void* buffer, size_t size)
+{
+    if (!IsReadable(address, size)) {
+        CountInvalid();
+        return false;
+    }
+    return ReadMemory(address, buffer, size) == static_cast<ssize_t>(size);
+}
+
+size_t MemorySource::ReadCheckedV(ReadOp* ops, size_t count)
+{
+    // Only the valid entries go to the backend, in one batch
+    std::vector<ReadOp> valid;
+    std::vector<size_t> positions;
+    valid.reserve(count);
+    positions.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        if (IsReadable(ops[i].address, ops[i].size)) {
+            valid.push_back(ops[i]);
+            positions.push_back(i);
+        } else {
+            ops[i].result = -1;
+            CountInvalid();
+        }
+    }
+    if (valid.empty()) {
+        return 0;
+    }
+    size_t complete = ReadMemoryV(valid.data(), valid.size());
+    for (size_t i = 0; i < valid.size(); ++i) {
+        ops[positions[i]].result = valid[i].result;
+    }
+    return complete;
+}
+
+bool MemorySource::ReadString(uintptr_t address, char* buffer, size_t size)
+{
+    buffer[0] = '\0';
+    size_t available = GetReadableSize(address, size - 1);
+    if (!available) {
+        CountInvalid();
+        return false;
+    }
+    ssize_t nread = ReadMemory(address, buffer, available);
+    if (nread < 1) {
+        return false;
+    }
+    buffer[nread] = '\0';
+    return true;
+}
+
+void MemorySource::CountRead(ssize_t bytes, bool bSyscall)
+{
+    if (!m_stats) {
+        return;
+    }
+    if (bSyscall) {
+        m_stats->readCalls++;
+    }
+    if (bytes > 0) {
+        m_stats->bytesRead += bytes;
+    }
+}
+
+void MemorySource::CountInvalid()
+{
+    if (m_stats) {
+        m_stats->invalidPointers++;
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef  __TUXDUMP_MEMORY_SOURCE_H__
+#define  __TUXDUMP_MEMORY_SOURCE_H__
+#include "regions.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+class Stats;
+
+/**
+ * One entry of a vectored read.  result receives the number of bytes read
+ * or -1 on failure.
+ */
+struct ReadOp {
+    uintptr_t address;
+    void* buffer;
+    size_t size;
+    ssize_t result;
+};
+
+/**
+ * Anything the tools can read target memory from: a live process, a core
+ * file, a snapshot or an image built in memory.  ReadChecked and ReadString
+ * validate the address against the region map first, so wild pointers
+ * are counted and rejected without touching the target.
+ */
+class MemorySource {
+    public:
+        virtual ~MemorySource() = default;
+        virtual ssize_t ReadMemory(uintptr_t address, void* buffer, size_t size) = 0;
+        virtual size_t ReadMemoryV(ReadOp* ops, size_t count);
+        virtual const uint8_t* GetView(uintptr_t address, size_t size);
+        /** Picks up a restarted target and its current mappings, false if it is gone */
+        virtual bool Refresh() { return true; }
+
+        const std::vector<Region>& GetRegions() const { return m_index.GetRegions(); }
+        const std::vector<Region>& GetModules() const { return m_index.GetModules(); }
+        const Region* GetRegion(const char* name) const { return m_index.FindModule(name); }
+        const Region* FindRegion(uintptr_t address) const { return m_index.Find(address); }
+        size_t GetReadableSize(uintptr_t address, size_t size) const;
+        bool IsReadable(uintptr_t address, size_t size) const { return GetReadableSize(address, size) == size; }
+
+        void SetStats(Stats* stats) { m_stats = stats; }
+        Stats* GetStats() const { return m_stats; }
+
+        bool ReadChecked(uintptr_t address, void* buffer, size_t size);
+        size_t ReadCheckedV(ReadOp* ops, size_t count);
+        bool ReadString(uintptr_t address, char* buffer, size_t size);
+
+        template<typename T>
+        T Read(uintptr_t address);
+        template<typename T>
+        bool ReadChecked(uintptr_t address, T& value) { return ReadChecked(address, &value, sizeof(T)); }
+    protected:
+        void SetRegions(const std::vector<Region>& regions) { m_index.Assign(regions); }
+        void CountRead(ssize_t bytes, bool bSyscall = false);
+        void CountInvalid();
+    private:
+        Stats* m_stats = nullptr;
+        RegionIndex m_index;
+};
+
+template<typename T>
+T MemorySource::Read(uintptr_t address)
+{
+    T value{};
+    ReadMemory(address, &value, sizeof(T));
+    return value;
+}
+
+#endif //__TUXDUMP_MEMORY_SOURCE_H__
@@ -0,0 +1,61 @@
+#include "synthetic.h"
+
+#include <algorithm>
+#include <cstring>
+
+uint8_t* SyntheticSource::AddRegion(uintptr_t start, size_t size, int perms, const std::string& path)
+{
+    std::unique_ptr<Block> block(new Block);
+    block->start = start;
+    block->data.resize(size);
+    uint8_t* data = block->data.data();
+    m_blocks.push_back(std::move(block));
+
+    Region region;
+    region.start = start;
+    region.end = start + size;
+    region.offset = 0;
+    region.perms = perms;
+    region.path = path.c_str();
+
+    std::vector<Region> regions = GetRegions();
+    regions.push_back(region);
+    SetRegions(regions);
+    return data;
+}
+
+uint8_t* SyntheticSource::GetData(uintptr_t address)
+{
+    const Block* block = FindBlock(address, 1);
+    if (!block) {
+        return nullptr;
+    }
+    return const_cast<uint8_t*>(block->data.data()) + (address - block->start);
+}
+
+const SyntheticSource::Block* SyntheticSource::FindBlock(uintptr_t address, size_t size) const
+{
+    for (const std::unique_ptr<Block>& block : m_blocks) {
+        if (address >= block->start && address - block->start + size <= block->data.size()) {
+            return block.get();
+        }
+    }
+    return nullptr;
+}
+
+ssize_t SyntheticSource::ReadMemory(uintptr_t address, void* buffer, size_t size)
+{
+    const Block* block = FindBlock(address, size);
+    if (!block) {
+        return -1;
+    }
+    memcpy(buffer, block->data.data() + (address - block->start), size);
+    CountRead(size);
+    return size;
+}
+
+const uint8_t* SyntheticSource::GetView(uintptr_t address, size_t size)
+{
+    const Block* block = FindBlock(address, size);
+    return block ? block->data.data() + (address - block->start) : nullptr;
+}
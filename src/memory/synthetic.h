@@ -0,0 +1,29 @@
+#ifndef  __TUXDUMP_MEMORY_SYNTHETIC_H__
+#define  __TUXDUMP_MEMORY_SYNTHETIC_H__
+#include "source.h"
+
+#include <memory>
+
+/**
+ * An address space assembled in memory, for building test images and
+ * benchmark inputs without a target process.
+ */
+class SyntheticSource : public MemorySource {
+    public:
+        uint8_t* AddRegion(uintptr_t start, size_t size, int perms, const std::string& path);
+        uint8_t* GetData(uintptr_t address);
+
+        ssize_t ReadMemory(uintptr_t address, void* buffer, size_t size) override;
+        const uint8_t* GetView(uintptr_t address, size_t size) override;
+    private:
+        struct Block {
+            uintptr_t start;
+            std::vector<uint8_t> data;
+        };
+    private:
+        const Block* FindBlock(uintptr_t address, size_t size) const;
+    private:
+        std::vector<std::unique_ptr<Block>> m_blocks;
+};
+
+#endif //__TUXDUMP_MEMORY_SYNTHETIC_H__
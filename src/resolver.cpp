@@ -0,0 +1,62 @@
+#include "resolver.h"
+
+#include <algorithm>
+
+size_t PointerResolver::Add(uintptr_t address, const std::vector<int>& hops)
+{
+    Chain chain;
+    chain.address = address;
+    chain.hops = hops;
+    chain.next = 0;
+    m_chains.push_back(chain);
+    return m_chains.size() - 1;
+}
+
+void PointerResolver::Resolve()
+{
+    std::vector<uintptr_t> pending;
+    std::vector<uintptr_t> values;
+    std::vector<ReadOp> ops;
+    for (;;) {
+        // Gather the distinct addresses the next level still needs
+        pending.clear();
+        bool bActive = false;
+        for (const Chain& chain : m_chains) {
+            if (!chain.address || chain.next == chain.hops.size()) {
+                continue;
+            }
+            bActive = true;
+            uintptr_t target = chain.address + chain.hops[chain.next];
+            if (!m_memo.count(target)) {
+                pending.push_back(target);
+            }
+        }
+        if (!bActive) {
+            break;
+        }
+
+        std::sort(pending.begin(), pending.end());
+        pending.erase(std::unique(pending.begin(), pending.end()), pending.end());
+        values.assign(pending.size(), 0);
+        ops.resize(pending.size());
+        for (size_t i = 0; i < pending.size(); ++i) {
+            ops[i] = {pending[i], &values[i], m_pointerSize, 0};
+        }
+        m_mem.ReadCheckedV(ops.data(), ops.size());
+        for (size_t i = 0; i < pending.size(); ++i) {
+            m_memo[pending[i]] = ops[i].result == static_cast<ssize_t>(m_pointerSize) ? values[i] : 0;
+        }
+
+        for (Chain& chain : m_chains) {
+            if (chain.address && chain.next < chain.hops.size()) {
+                chain.address = m_memo[chain.address + chain.hops[chain.next++]];
+            }
+        }
+    }
+}
+
+void PointerResolver::Clear()
+{
+    m_chains.clear();
+    m_memo.clear();
+}
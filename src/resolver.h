@@ -0,0 +1,36 @@
+#ifndef  __TUXDUMP_RESOLVER_H__
+#define  __TUXDUMP_RESOLVER_H__
+#include "memory/source.h"
+
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Follows pointer chains level by level: the next hop of every pending
+ * chain is fetched with one vectored read, so resolving costs one round
+ * trip per depth instead of one per hop.  Every dereferenced address is
+ * memoized, chains sharing a target or a prefix read it only once.
+ * Pointers are pointerSize bytes wide, 4 for 32-bit targets.
+ */
+class PointerResolver {
+    public:
+        explicit PointerResolver(MemorySource& mem, size_t pointerSize = sizeof(uintptr_t))
+            : m_mem(mem), m_pointerSize(pointerSize) {}
+        size_t Add(uintptr_t address, const std::vector<int>& hops);
+        void Resolve();
+        uintptr_t GetResult(size_t chain) const { return m_chains[chain].address; }
+        void Clear();
+    private:
+        struct Chain {
+            uintptr_t address;
+            std::vector<int> hops;
+            size_t next;
+        };
+    private:
+        MemorySource& m_mem;
+        size_t m_pointerSize;
+        std::vector<Chain> m_chains;
+        std::unordered_map<uintptr_t, uintptr_t> m_memo;
+};
+
+#endif //__TUXDUMP_RESOLVER_H__
@@ -0,0 +1,370 @@
+#include "scanner.h"
+#include "logger.h"
+#include "stats.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+static const size_t HINT_WINDOW = 64 * 1024;
+
+static int HexValue(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    c = tolower(c);
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+bool Pattern::Parse(const char* text)
+{
+    m_bytes.clear();
+    m_mask.clear();
+    while (*text) {
+        if (isspace(*text)) {
+            text++;
+        } else if (*text == '?') {
+            m_bytes.push_back(0);
+            m_mask.push_back(0);
+            text++;
+        } else {
+            int high = HexValue(text[0]);
+            int low = text[1] ? HexValue(text[1]) : -1;
+            if (high < 0 || low < 0) {
+                return false;
+            }
+            m_bytes.push_back(static_cast<uint8_t>(high << 4 | low));
+            m_mask.push_back(0xff);
+            text += 2;
+        }
+    }
+
+    m_anchor = 0;
+    while (m_anchor < m_mask.size() && !m_mask[m_anchor]) {
+        m_anchor++;
+    }
+    return !m_bytes.empty() && m_anchor < m_mask.size();
+}
+
+const uint8_t* Pattern::Find(const uint8_t* begin, const uint8_t* end) const
+{
+    size_t size = m_bytes.size();
+    if (static_cast<size_t>(end - begin) < size) {
+        return nullptr;
+    }
+
+    // Jump between occurrences of the first fixed byte, then verify
+    const uint8_t* last = end - size;
+    const uint8_t* cursor = begin + m_anchor;
+    while (cursor <= last + m_anchor) {
+        cursor = static_cast<const uint8_t*>(memchr(cursor, m_bytes[m_anchor], last + m_anchor - cursor + 1));
+        if (!cursor) {
+            return nullptr;
+        }
+        const uint8_t* candidate = cursor - m_anchor;
+        size_t i = 0;
+        while (i < size && (candidate[i] & m_mask[i]) == m_bytes[i]) {
+            i++;
+        }
+        if (i == size) {
+            return candidate;
+        }
+        cursor++;
+    }
+    return nullptr;
+}
+
+const uint8_t* Pattern::FindBest(const uint8_t* begin, const uint8_t* end, size_t maxMismatches,
+        size_t& mismatches) const
+{
+    // Shift-Add: one saturating mismatch counter per pattern byte, packed
+    // into 64-bit words.  Each counter has a sticky overflow bit on top, the
+    // width is the smallest power of two that can hold maxMismatches.
+    size_t size = m_bytes.size();
+    size_t bits = 2;
+    while ((1ull << (bits - 1)) <= maxMismatches) {
+        bits *= 2;
+    }
+    if (bits > 16 || static_cast<size_t>(end - begin) < size) {
+        return nullptr;
+    }
+    size_t perWord = 64 / bits;
+    size_t words = (size + perWord - 1) / perWord;
+    uint64_t counter = (1ull << (bits - 1)) - 1;
+    uint64_t high = 0;
+    for (size_t i = 0; i < perWord; ++i) {
+        high |= 1ull << (i * bits + bits - 1);
+    }
+
+    std::vector<uint64_t> table(256 * words, 0);
+    for (size_t i = 0; i < size; ++i) {
+        for (int c = 0; c < 256 && m_mask[i]; ++c) {
+            if ((c & m_mask[i]) != m_bytes[i]) {
+                table[c * words + i / perWord] |= 1ull << (i % perWord * bits);
+            }
+        }
+    }
+
+    std::vector<uint64_t> state(words, 0);
+    std::vector<uint64_t> overflow(words, 0);
+    size_t lastWord = (size - 1) / perWord;
+    size_t lastShift = (size - 1) % perWord * bits;
+    const uint8_t* best = nullptr;
+    mismatches = maxMismatches + 1;
+    for (const uint8_t* cursor = begin; cursor < end; ++cursor) {
+        const uint64_t* row = &table[*cursor * words];
+        uint64_t carry = 0;
+        uint64_t carryOverflow = 0;
+        for (size_t w = 0; w < words; ++w) {
+            uint64_t value = state[w];
+            uint64_t flags = overflow[w];
+            uint64_t nextCarry = value >> (64 - bits);
+            uint64_t nextCarryOverflow = flags >> (64 - bits);
+            value = ((value << bits) | carry) + row[w];
+            flags = (flags << bits) | carryOverflow | (value & high);
+            state[w] = value & ~high;
+            overflow[w] = flags;
+            carry = nextCarry;
+            carryOverflow = nextCarryOverflow;
+        }
+
+        if (static_cast<size_t>(cursor - begin) + 1 < size
+                || (overflow[lastWord] >> lastShift) & (counter + 1)) {
+            continue;
+        }
+        size_t count = (state[lastWord] >> lastShift) & counter;
+        if (count < mismatches) {
+            mismatches = count;
+            best = cursor + 1 - size;
+            if (!count) {
+                break;
+            }
+        }
+    }
+    return best;
+}
+
+const Scanner::Image& Scanner::GetImage(const Region* module)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Stats* stats = m_mem.GetStats();
+    auto it = m_images.find(module->start);
+    if (it != m_images.end()) {
+        if (stats) {
+            stats->cacheHits++;
+        }
+        return it->second;
+    }
+    if (stats) {
+        stats->cacheMisses++;
+    }
+
+    Image& image = m_images[module->start];
+    image.size = module->GetSize();
+    image.data = m_mem.GetView(module->start, image.size);
+    if (image.data) {
+        return image;
+    }
+
+    // Copy every readable mapping of the module, leaving holes zeroed
+    image.storage.resize(image.size);
+    for (const Region& region : m_mem.GetRegions()) {
+        if (region.start < module->start || region.end > module->end
+                || !(region.perms & PROT_READ)) {
+            continue;
+        }
+        m_mem.ReadMemory(region.start, &image.storage[region.start - module->start], region.GetSize());
+    }
+    image.data = image.storage.data();
+    return image;
+}
+
+/**
+ * Searches for matches starting in [first, last) and returns the match
+ * and the number of bytes looked at.
+ */
+static const uint8_t* FindRange(const Pattern& pattern, const uint8_t* data, size_t size,
+        size_t first, size_t last, size_t& scanned)
+{
+    if (first >= last) {
+        return nullptr;
+    }
+    size_t end = std::min(last + pattern.Size() - 1, size);
+    const uint8_t* match = pattern.Find(data + first, data + end);
+    scanned += match ? match - (data + first) + pattern.Size() : end - first;
+    return match;
+}
+
+uintptr_t Scanner::FindPattern(const Region* module, const char* pattern, size_t offset, uintptr_t hint)
+{
+    Pattern parsed;
+    if (!module || !parsed.Parse(pattern)) {
+        return 0;
+    }
+
+    const Image& image = GetImage(module);
+    uint64_t start = Stats::Now();
+    size_t scanned = 0;
+    const uint8_t* match = nullptr;
+    if (module->Contains(hint)) {
+        // Widen the window around the hint, only scanning the new parts
+        size_t center = hint - module->start;
+        size_t low = center;
+        size_t high = center;
+        size_t rounds = 0;
+        for (size_t window = HINT_WINDOW; !match && (low > 0 || high < image.size); window *= 8) {
+            rounds++;
+            size_t newLow = center > window ? center - window : 0;
+            size_t newHigh = std::min(center + window, image.size);
+            match = FindRange(parsed, image.data, image.size, high, newHigh, scanned);
+            if (!match) {
+                match = FindRange(parsed, image.data, image.size, newLow, low, scanned);
+            }
+            low = newLow;
+            high = newHigh;
+        }
+        // Only a match in the first window means the hint was still good
+        if (match && rounds == 1 && m_mem.GetStats()) {
+            m_mem.GetStats()->hintHits++;
+        }
+    } else {
+        match = FindRange(parsed, image.data, image.size, 0, image.size, scanned);
+    }
+    if (Stats* stats = m_mem.GetStats()) {
+        stats->scanTime += Stats::Now() - start;
+        stats->scanBytes += scanned;
+    }
+    if (!match) {
+        return 0;
+    }
+    return module->start + (match - image.data) + offset;
+}
+
+uintptr_t Scanner::FindPatternApprox(const Region* module, const char* pattern, size_t offset,
+        size_t maxMismatches, size_t& mismatches)
+{
+    Pattern parsed;
+    if (!module || !parsed.Parse(pattern)) {
+        return 0;
+    }
+
+    const Image& image = GetImage(module);
+    uint64_t start = Stats::Now();
+    const uint8_t* match = parsed.FindBest(image.data, image.data + image.size, maxMismatches, mismatches);
+    if (Stats* stats = m_mem.GetStats()) {
+        stats->scanTime += Stats::Now() - start;
+        stats->scanBytes += image.size;
+    }
+    if (!match) {
+        return 0;
+    }
+    return module->start + (match - image.data) + offset;
+}
+
+uintptr_t Scanner::FindPattern(const char* module, const char* pattern, size_t offset)
+{
+    return FindPattern(m_mem.GetRegion(module), pattern, offset);
+}
+
+uintptr_t Scanner::GetCallAddress(uintptr_t address)
+{
+    if (!address) {
+        return 0;
+    }
+    int32_t displacement;
+    if (!Read(address + 1, &displacement, sizeof(displacement))) {
+        return 0;
+    }
+    return address + 5 + displacement;
+}
+
+/**
+ * Decodes the index-th instruction starting at address and returns its
+ * address, 0 if the code there does not decode.  Every match keeps the
+ * instructions decoded so far, so entries sharing a match decode it once.
+ */
+uintptr_t Scanner::Decode(uintptr_t address, size_t index, Instruction& insn)
+{
+    if (!address) {
+        return 0;
+    }
+    std::lock_guard<std::mutex> lock(m_decodeMutex);
+    std::vector<Instruction>& decoded = m_decoded[address];
+    uintptr_t at = address;
+    for (const Instruction& previous : decoded) {
+        at += previous.length;
+    }
+    while (decoded.size() <= index) {
+        uint8_t code[15];
+        size_t size = m_mem.GetReadableSize(at, sizeof(code));
+        if (size && !Read(at, code, size)) {
+            size = 0;
+        }
+        Instruction next;
+        if (!size || !next.Decode(code, size)) {
+            return 0;
+        }
+        decoded.push_back(next);
+        at += next.length;
+    }
+
+    insn = decoded[index];
+    for (size_t i = index; i < decoded.size(); ++i) {
+        at -= decoded[i].length;
+    }
+    return at;
+}
+
+const XrefIndex& Scanner::GetXrefs(const Region* module, ThreadPool& pool)
+{
+    std::lock_guard<std::mutex> lock(m_xrefMutex);
+    auto it = m_xrefs.find(module->start);
+    if (it != m_xrefs.end()) {
+        return it->second;
+    }
+
+    const Image& image = GetImage(module);
+    ScopedPhase phase(m_mem.GetStats(), "XrefIndex", module->name);
+    phase.AddBytes(image.size);
+    XrefIndex& xrefs = m_xrefs[module->start];
+    xrefs.Build(m_mem, module, image.data, pool);
+    Logger::Debug("{}: {} cross references", module->name, xrefs.GetSize());
+    return xrefs;
+}
+
+const StringIndex& Scanner::GetStrings(const Region* module, ThreadPool& pool)
+{
+    const XrefIndex& xrefs = GetXrefs(module, pool);
+    std::lock_guard<std::mutex> lock(m_xrefMutex);
+    auto it = m_strings.find(module->start);
+    if (it != m_strings.end()) {
+        return it->second;
+    }
+
+    ScopedPhase phase(m_mem.GetStats(), "StringIndex", module->name);
+    StringIndex& strings = m_strings[module->start];
+    strings.Build(module, GetImage(module).data, xrefs);
+    Logger::Debug("{}: {} referenced strings", module->name, strings.GetSize());
+    return strings;
+}
+
+bool Scanner::Read(uintptr_t address, void* buffer, size_t size)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_images.upper_bound(address);
+        if (it != m_images.begin()) {
+            --it;
+            const Image& image = it->second;
+            if (address - it->first < image.size && size <= image.size - (address - it->first)) {
+                memcpy(buffer, image.data + (address - it->first), size);
+                return true;
+            }
+        }
+    }
+    return m_mem.ReadChecked(address, buffer, size);
+}
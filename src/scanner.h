@@ -0,0 +1,77 @@
+#ifndef  __TUXDUMP_SCANNER_H__
+#define  __TUXDUMP_SCANNER_H__
+#include "decoder.h"
+#include "memory/source.h"
+#include "threadpool.h"
+#include "xrefs.h"
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Byte pattern in the config notation: hex pairs with '?' matching any
+ * single byte, e.g. "488b?????5548".  FindBest allows a number of
+ * mismatching bytes and returns the closest match.
+ */
+class Pattern {
+    public:
+        bool Parse(const char* text);
+        size_t Size() const { return m_bytes.size(); }
+        const uint8_t* Bytes() const { return m_bytes.data(); }
+        const uint8_t* Mask() const { return m_mask.data(); }
+        const uint8_t* Find(const uint8_t* begin, const uint8_t* end) const;
+        const uint8_t* FindBest(const uint8_t* begin, const uint8_t* end, size_t maxMismatches,
+                size_t& mismatches) const;
+    private:
+        std::vector<uint8_t> m_bytes;
+        std::vector<uint8_t> m_mask;
+        size_t m_anchor = 0;
+};
+
+/**
+ * Pattern scanning over the modules of a memory source.  Given a hint (the
+ * address of a previous match) the search starts in a window around it
+ * and widens until the pattern is found or the module is covered.  Each
+ * module is read once and kept for the lifetime of the scanner, reads that
+ * fall inside a cached module are served from the copy.  The cross
+ * reference and string indexes of a module are built on first use and kept
+ * as well, as are the instructions decoded after each match.  Safe to
+ * share between threads.
+ */
+class Scanner {
+    public:
+        explicit Scanner(MemorySource& mem) : m_mem(mem) {}
+        uintptr_t FindPattern(const Region* module, const char* pattern, size_t offset,
+                uintptr_t hint = 0);
+        uintptr_t FindPatternApprox(const Region* module, const char* pattern, size_t offset,
+                size_t maxMismatches, size_t& mismatches);
+        uintptr_t FindPattern(const char* module, const char* pattern, size_t offset);
+        uintptr_t GetCallAddress(uintptr_t address);
+        uintptr_t Decode(uintptr_t address, size_t index, Instruction& insn);
+        const uint8_t* GetModuleData(const Region* module) { return GetImage(module).data; }
+        const XrefIndex& GetXrefs(const Region* module, ThreadPool& pool);
+        const StringIndex& GetStrings(const Region* module, ThreadPool& pool);
+        bool Read(uintptr_t address, void* buffer, size_t size);
+    private:
+        struct Image {
+            const uint8_t* data;
+            size_t size;
+            std::vector<uint8_t> storage;
+        };
+    private:
+        const Image& GetImage(const Region* module);
+    private:
+        MemorySource& m_mem;
+        std::mutex m_mutex;
+        std::map<uintptr_t, Image> m_images;
+        std::mutex m_xrefMutex;
+        std::map<uintptr_t, XrefIndex> m_xrefs;
+        std::map<uintptr_t, StringIndex> m_strings;
+        std::mutex m_decodeMutex;
+        std::unordered_map<uintptr_t, std::vector<Instruction>> m_decoded;
+};
+
+#endif //__TUXDUMP_SCANNER_H__
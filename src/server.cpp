@@ -0,0 +1,389 @@
+#include "server.h"
+#include "logger.h"
+#include "tools/tools.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <utility>
+
+#include <rapidjson/document.h>
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static const size_t MAX_LINE = 64 * 1024;
+static const size_t MAX_OUTPUT = 64 * 1024 * 1024;
+
+static volatile sig_atomic_t s_bStop = 0;
+
+static void StopHandler(int)
+{
+    s_bStop = 1;
+}
+
+static void Flatten(const rapidjson::Value& object, const std::string& scope,
+        std::vector<OffsetIndex::Entry>& out)
+{
+    for (auto it = object.MemberBegin(); it != object.MemberEnd(); ++it) {
+        std::string name = scope.empty() ? it->name.GetString()
+            : scope + "." + it->name.GetString();
+        if (it->value.IsObject()) {
+            Flatten(it->value, name, out);
+        } else if (it->value.IsUint64()) {
+            out.push_back({name, it->value.GetUint64()});
+        }
+    }
+}
+
+bool OffsetIndex::Load(const std::string& json, const std::string& table)
+{
+    rapidjson::Document doc;
+    doc.Parse(json.c_str());
+    if (doc.HasParseError() || !doc.IsObject()) {
+        return false;
+    }
+
+    // Keep a compact copy for full-table fetches
+    rapidjson::StringBuffer compact;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(compact);
+    doc.Accept(writer);
+    m_tables[table] = compact.GetString();
+
+    Flatten(doc, "", m_entries);
+    Rebuild();
+    return true;
+}
+
+void OffsetIndex::AddAliases(const std::map<std::string, std::string>& aliases)
+{
+    std::vector<Entry> added;
+    for (const std::pair<const std::string, std::string>& alias : aliases) {
+        if (alias.first == alias.second) {
+            continue;
+        }
+        std::vector<const Entry*> entries;
+        FindPrefix(alias.first + ".", entries);
+        for (const Entry* entry : entries) {
+            added.push_back({alias.second + entry->name.substr(alias.first.size()), entry->value});
+        }
+    }
+    m_entries.insert(m_entries.end(), added.begin(), added.end());
+    Rebuild();
+}
+
+size_t OffsetIndex::CountResolved() const
+{
+    return std::count_if(m_entries.begin(), m_entries.end(), [](const Entry& e) { return e.value != 0; });
+}
+
+void OffsetIndex::Rebuild()
+{
+    std::sort(m_entries.begin(), m_entries.end(),
+            [](const Entry& a, const Entry& b) { return a.name < b.name; });
+    m_lookup.clear();
+    m_lookup.reserve(m_entries.size());
+    for (size_t i = 0; i < m_entries.size(); ++i) {
+        m_lookup[m_entries[i].name] = i;
+    }
+}
+
+const OffsetIndex::Entry* OffsetIndex::Find(const std::string& name) const
+{
+    auto it = m_lookup.find(name);
+    if (it == m_lookup.end()) {
+        return nullptr;
+    }
+    return &m_entries[it->second];
+}
+
+void OffsetIndex::FindPrefix(const std::string& prefix, std::vector<const Entry*>& out) const
+{
+    auto it = std::lower_bound(m_entries.begin(), m_entries.end(), prefix,
+            [](const Entry& e, const std::string& p) { return e.name < p; });
+    for (; it != m_entries.end() && !it->name.compare(0, prefix.size(), prefix); ++it) {
+        out.push_back(&*it);
+    }
+}
+
+const std::string* OffsetIndex::GetTable(const std::string& table) const
+{
+    auto it = m_tables.find(table);
+    if (it == m_tables.end()) {
+        return nullptr;
+    }
+    return &it->second;
+}
+
+Server::~Server()
+{
+    for (Client& client : m_clients) {
+        close(client.fd);
+    }
+    if (m_fd != -1) {
+        close(m_fd);
+        unlink(m_path.c_str());
+    }
+}
+
+/**
+ * Clears the way for bind: only a socket nobody listens on any more is
+ * removed, anything else at the path is left alone.
+ */
+static bool RemoveStaleSocket(const sockaddr_un& addr)
+{
+    struct stat st;
+    if (lstat(addr.sun_path, &st) == -1) {
+        return errno == ENOENT;
+    }
+    if (!S_ISSOCK(st.st_mode)) {
+        Logger::Error("\"{}\" exists and is not a socket", addr.sun_path);
+        return false;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        Logger::Error("socket: {}", strerror(errno));
+        return false;
+    }
+    bool bLive = connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) == 0;
+    close(fd);
+    if (bLive) {
+        Logger::Error("Another server is listening on \"{}\"", addr.sun_path);
+        return false;
+    }
+    unlink(addr.sun_path);
+    return true;
+}
+
+bool Server::Listen(const char* path)
+{
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        Logger::Error("Socket path too long: \"{}\"", path);
+        return false;
+    }
+    strcpy(addr.sun_path, path);
+
+    if (!RemoveStaleSocket(addr)) {
+        return false;
+    }
+
+    m_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (m_fd == -1) {
+        Logger::Error("socket: {}", strerror(errno));
+        return false;
+    }
+
+    if (bind(m_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1
+            || listen(m_fd, 16) == -1) {
+        Logger::Error("Failed to listen on \"{}\": {}", path, strerror(errno));
+        close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+    m_path = path;
+    return true;
+}
+
+/**
+ * The dumps run against a fresh index, which only replaces the served one
+ * when they resolved something: a target that went away leaves the last
+ * good offsets in place.
+ */
+bool Server::Reload()
+{
+    if (!m_ctx.GetMemory().Refresh()) {
+        Logger::Error("Failed to re-attach to the target");
+        return false;
+    }
+    OffsetIndex index;
+    if (!index.Load(Tools::ScanSignatures(m_ctx), "signatures")) {
+        Logger::Error("Failed to index signatures");
+        return false;
+    }
+    std::map<std::string, std::string> tables;
+    if (!index.Load(Tools::ScanNetvars(m_ctx, &tables), "netvars")) {
+        Logger::Error("Failed to index netvars");
+        return false;
+    }
+    index.AddAliases(tables);
+    if (!index.CountResolved()) {
+        Logger::Error("Nothing resolved, keeping the previous {} offsets", m_index.Size());
+        return false;
+    }
+    m_index = std::move(index);
+    Logger::Log("Indexed {} offsets", m_index.Size());
+    return true;
+}
+
+void Server::Reply(Client& client, const std::string& reply)
+{
+    client.output += reply;
+    client.output += '\n';
+}
+
+/**
+ * Sends what the socket takes without blocking, false once the client is
+ * gone.  The rest waits for POLLOUT.
+ */
+bool Server::Flush(Client& client)
+{
+    while (client.sent < client.output.size()) {
+        ssize_t written = send(client.fd, client.output.data() + client.sent,
+                client.output.size() - client.sent, MSG_NOSIGNAL);
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        client.sent += written;
+    }
+    client.output.clear();
+    client.sent = 0;
+    return true;
+}
+
+/**
+ * Reads what arrived and answers every complete line, false once the
+ * client is gone or has to be dropped.
+ */
+bool Server::Receive(Client& client)
+{
+    char buffer[4096];
+    ssize_t received = recv(client.fd, buffer, sizeof(buffer), 0);
+    if (received == -1) {
+        return errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+    if (received == 0) {
+        return false;
+    }
+    client.buffer.append(buffer, received);
+    size_t eol;
+    while ((eol = client.buffer.find('\n')) != std::string::npos) {
+        std::string line = client.buffer.substr(0, eol);
+        client.buffer.erase(0, eol + 1);
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (!HandleLine(client, line)) {
+            return false;
+        }
+        if (client.output.size() > MAX_OUTPUT) {
+            Logger::Debug("Dropping client {}: {} bytes of replies unread", client.fd, client.output.size());
+            return false;
+        }
+    }
+    if (client.buffer.size() > MAX_LINE) {
+        Logger::Debug("Dropping client {}: request line over {} bytes", client.fd, MAX_LINE);
+        return false;
+    }
+    return true;
+}
+
+bool Server::HandleLine(Client& client, const std::string& line)
+{
+    size_t split = line.find(' ');
+    std::string command = line.substr(0, split);
+    std::string argument = split == std::string::npos ? "" : line.substr(split + 1);
+
+    rapidjson::StringBuffer reply;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(reply);
+    writer.StartObject();
+    if (command == "get") {
+        const OffsetIndex::Entry* entry = m_index.Find(argument);
+        if (entry) {
+            writer.Key("name");
+            writer.String(entry->name.c_str());
+            writer.Key("value");
+            writer.Uint64(entry->value);
+        } else {
+            writer.Key("error");
+            writer.String("not found");
+        }
+    } else if (command == "prefix" || command == "table") {
+        const std::string* table = m_index.GetTable(argument);
+        if (command == "table" && table) {
+            Reply(client, *table);
+            return true;
+        }
+        std::vector<const OffsetIndex::Entry*> entries;
+        m_index.FindPrefix(command == "table" ? argument + "." : argument, entries);
+        writer.Key("results");
+        writer.StartObject();
+        for (const OffsetIndex::Entry* entry : entries) {
+            writer.Key(entry->name.c_str());
+            writer.Uint64(entry->value);
+        }
+        writer.EndObject();
+    } else if (command == "reload") {
+        writer.Key("ok");
+        writer.Bool(Reload());
+    } else if (command == "quit") {
+        return false;
+    } else {
+        writer.Key("error");
+        writer.String("unknown command");
+    }
+    writer.EndObject();
+    Reply(client, reply.GetString());
+    return true;
+}
+
+void Server::Run()
+{
+    signal(SIGINT, StopHandler);
+    signal(SIGTERM, StopHandler);
+    Logger::Log("Listening on \"{}\"", m_path);
+
+    std::vector<pollfd> fds;
+    while (!s_bStop) {
+        fds.clear();
+        fds.push_back({m_fd, POLLIN, 0});
+        for (const Client& client : m_clients) {
+            short events = client.output.empty() ? POLLIN : POLLIN | POLLOUT;
+            fds.push_back({client.fd, events, 0});
+        }
+
+        if (poll(fds.data(), fds.size(), -1) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            Logger::Error("poll: {}", strerror(errno));
+            break;
+        }
+
+        // Clients first, so indices still line up with fds
+        for (size_t i = m_clients.size(); i-- > 0;) {
+            short revents = fds[i + 1].revents;
+            if (!revents) {
+                continue;
+            }
+            Client& client = m_clients[i];
+            bool bKeep = !(revents & POLLOUT) || Flush(client);
+            if (bKeep && (revents & (POLLIN | POLLHUP | POLLERR))) {
+                bKeep = Receive(client) && Flush(client);
+            }
+            if (!bKeep) {
+                close(client.fd);
+                m_clients.erase(m_clients.begin() + i);
+            }
+        }
+
+        if (fds[0].revents & POLLIN) {
+            int fd = accept4(m_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd != -1) {
+                m_clients.push_back({fd, std::string(), std::string(), 0});
+            }
+        }
+    }
+}
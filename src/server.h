@@ -0,0 +1,81 @@
+#ifndef  __TUXDUMP_SERVER_H__
+#define  __TUXDUMP_SERVER_H__
+#include "context.h"
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Flattened view of the dump results.  Nested tables are joined with dots,
+ * so netvars are addressed as "CBasePlayer.m_iHealth" and signatures by
+ * their plain name; aliases make a class reachable by its RecvTable name,
+ * "DT_BasePlayer.m_iHealth", as well.  Names are kept sorted for prefix
+ * queries and hashed for single lookups.
+ */
+class OffsetIndex {
+    public:
+        struct Entry {
+            std::string name;
+            uint64_t value;
+        };
+    public:
+        bool Load(const std::string& json, const std::string& table);
+        void AddAliases(const std::map<std::string, std::string>& aliases);
+        size_t CountResolved() const;
+        const Entry* Find(const std::string& name) const;
+        void FindPrefix(const std::string& prefix, std::vector<const Entry*>& out) const;
+        const std::string* GetTable(const std::string& table) const;
+        size_t Size() const { return m_entries.size(); }
+    private:
+        void Rebuild();
+    private:
+        std::vector<Entry> m_entries;
+        std::unordered_map<std::string, size_t> m_lookup;
+        std::unordered_map<std::string, std::string> m_tables;
+};
+
+/**
+ * Answers offset queries over a Unix domain socket.  Requests are single
+ * text lines, replies are single lines of JSON:
+ *
+ *     get <name>       {"name":"dwClientState","value":1234}
+ *     prefix <prefix>  {"results":{"dwClientState":1234,...}}
+ *     table <name>     full output of a tool, or every entry of a netvar table
+ *     reload           re-attach, re-run the dumps and swap in the new index
+ *     quit             close the connection
+ *
+ * Clients never block the loop: replies are queued until the socket takes
+ * them, and a client sending an endless line or leaving too many replies
+ * unread is dropped.
+ */
+class Server {
+    public:
+        explicit Server(Context& ctx) : m_ctx(ctx) {}
+        ~Server();
+        bool Listen(const char* path);
+        bool Reload();
+        void Run();
+    private:
+        struct Client {
+            int fd;
+            std::string buffer;
+            std::string output;
+            size_t sent;
+        };
+    private:
+        bool HandleLine(Client& client, const std::string& line);
+        void Reply(Client& client, const std::string& reply);
+        bool Flush(Client& client);
+        bool Receive(Client& client);
+    private:
+        Context& m_ctx;
+        OffsetIndex m_index;
+        std::vector<Client> m_clients;
+        std::string m_path;
+        int m_fd = -1;
+};
+
+#endif //__TUXDUMP_SERVER_H__
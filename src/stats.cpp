@@ -0,0 +1,140 @@
+#include "stats.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <map>
+
+#include <rapidjson/filewritestream.h>
+#include <rapidjson/writer.h>
+
+uint64_t Stats::Now()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+void Stats::AddPhase(Phase phase)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_phases.push_back(std::move(phase));
+}
+
+void Stats::PrintSummary()
+{
+    struct Total {
+        size_t order;
+        size_t count;
+        uint64_t duration;
+        uint64_t bytes;
+    };
+    std::map<std::string, Total> totals;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const Phase& phase : m_phases) {
+            auto it = totals.insert({phase.name, {totals.size(), 0, 0, 0}}).first;
+            it->second.count++;
+            it->second.duration += phase.duration;
+            it->second.bytes += phase.bytes;
+        }
+    }
+
+    std::vector<std::pair<std::string, Total>> ordered(totals.begin(), totals.end());
+    std::sort(ordered.begin(), ordered.end(),
+            [](const std::pair<std::string, Total>& a, const std::pair<std::string, Total>& b) {
+                return a.second.order < b.second.order;
+            });
+
+    Logger::Log("Stats:");
+    Logger::Log("    {:<20} {:>8} {:>12} {:>14}", "phase", "count", "total ms", "bytes");
+    for (const auto& total : ordered) {
+        Logger::Log("    {:<20} {:>8} {:>12.3f} {:>14}", total.first, total.second.count,
+                total.second.duration / 1e6, total.second.bytes);
+    }
+
+    double scanSeconds = scanTime / 1e9;
+    Logger::Log("    {:<20} {:>14}", "bytes read", bytesRead.load());
+    Logger::Log("    {:<20} {:>14}", "read syscalls", readCalls.load());
+    Logger::Log("    {:<20} {:>14}", "invalid pointers", invalidPointers.load());
+    Logger::Log("    {:<20} {:>14}", "cache hits", cacheHits.load());
+    Logger::Log("    {:<20} {:>14}", "cache misses", cacheMisses.load());
+    Logger::Log("    {:<20} {:>14}", "bytes scanned", scanBytes.load());
+    Logger::Log("    {:<20} {:>14}", "hinted matches", hintHits.load());
+    Logger::Log("    {:<20} {:>14.1f}", "scan MB/s", scanSeconds > 0 ? scanBytes / scanSeconds / 1e6 : 0.0);
+}
+
+bool Stats::WriteTrace(const char* path)
+{
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        return false;
+    }
+
+    char buffer[65536];
+    rapidjson::FileWriteStream stream(file, buffer, sizeof(buffer));
+    rapidjson::Writer<rapidjson::FileWriteStream> writer(stream);
+    writer.StartObject();
+    writer.Key("traceEvents");
+    writer.StartArray();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const Phase& phase : m_phases) {
+            writer.StartObject();
+            writer.Key("name");
+            writer.String(phase.detail.empty() ? phase.name.c_str() : phase.detail.c_str());
+            writer.Key("cat");
+            writer.String(phase.name.c_str());
+            writer.Key("ph");
+            writer.String("X");
+            writer.Key("ts");
+            writer.Double((phase.start - m_origin) / 1e3);
+            writer.Key("dur");
+            writer.Double(phase.duration / 1e3);
+            writer.Key("pid");
+            writer.Int(1);
+            writer.Key("tid");
+            writer.Int(phase.thread);
+            writer.Key("args");
+            writer.StartObject();
+            writer.Key("bytes");
+            writer.Uint64(phase.bytes);
+            writer.EndObject();
+            writer.EndObject();
+        }
+    }
+    writer.EndArray();
+    writer.Key("displayTimeUnit");
+    writer.String("ms");
+    writer.EndObject();
+    stream.Flush();
+    return fclose(file) == 0;
+}
+
+static int ThreadId()
+{
+    static std::atomic<int> s_next{1};
+    static thread_local int s_id = s_next++;
+    return s_id;
+}
+
+ScopedPhase::ScopedPhase(Stats* stats, const char* name, const char* detail)
+    : m_stats(stats && stats->IsEnabled() ? stats : nullptr), m_name(name), m_detail(detail),
+    m_start(m_stats ? Stats::Now() : 0)
+{
+}
+
+ScopedPhase::~ScopedPhase()
+{
+    Stop();
+}
+
+void ScopedPhase::Stop()
+{
+    if (!m_stats) {
+        return;
+    }
+    m_stats->AddPhase({m_name, m_detail, m_start, Stats::Now() - m_start, m_bytes, ThreadId()});
+    m_stats = nullptr;
+}
@@ -0,0 +1,64 @@
+#ifndef  __TUXDUMP_STATS_H__
+#define  __TUXDUMP_STATS_H__
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * Timing and counters of a dump.  Phases are only recorded once Enable()
+ * has been called, the counters are always kept since they are cheap.
+ */
+class Stats {
+    public:
+        struct Phase {
+            std::string name;
+            std::string detail;
+            uint64_t start;
+            uint64_t duration;
+            uint64_t bytes;
+            int thread;
+        };
+    public:
+        void Enable() { m_bEnabled = true; }
+        bool IsEnabled() const { return m_bEnabled; }
+        static uint64_t Now();
+
+        void AddPhase(Phase phase);
+        void PrintSummary();
+        bool WriteTrace(const char* path);
+    public:
+        std::atomic<uint64_t> bytesRead{0};
+        std::atomic<uint64_t> readCalls{0};
+        std::atomic<uint64_t> cacheHits{0};
+        std::atomic<uint64_t> cacheMisses{0};
+        std::atomic<uint64_t> scanBytes{0};
+        std::atomic<uint64_t> scanTime{0};
+        std::atomic<uint64_t> hintHits{0};
+        std::atomic<uint64_t> invalidPointers{0};
+    private:
+        bool m_bEnabled = false;
+        uint64_t m_origin = Now();
+        std::mutex m_mutex;
+        std::vector<Phase> m_phases;
+};
+
+/**
+ * Records the lifetime of the object, or the time until Stop(), as a phase.
+ */
+class ScopedPhase {
+    public:
+        ScopedPhase(Stats* stats, const char* name, const char* detail = "");
+        ~ScopedPhase();
+        void Stop();
+        void AddBytes(uint64_t bytes) { m_bytes += bytes; }
+    private:
+        Stats* m_stats;
+        const char* m_name;
+        const char* m_detail;
+        uint64_t m_start;
+        uint64_t m_bytes = 0;
+};
+
+#endif //__TUXDUMP_STATS_H__
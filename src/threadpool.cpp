@@ -0,0 +1,84 @@
+#include "threadpool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(size_t threads)
+{
+    if (!threads) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (size_t i = 1; i < threads; ++i) {
+        m_workers.emplace_back(&ThreadPool::WorkerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_bStop = true;
+    }
+    m_wake.notify_all();
+    for (std::thread& worker : m_workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::RunJob(const std::function<void(size_t)>& fn, size_t count)
+{
+    for (size_t i = m_next++; i < count; i = m_next++) {
+        fn(i);
+    }
+}
+
+void ThreadPool::ParallelFor(size_t count, const std::function<void(size_t)>& fn)
+{
+    if (m_workers.empty() || count < 2) {
+        for (size_t i = 0; i < count; ++i) {
+            fn(i);
+        }
+        return;
+    }
+
+    std::lock_guard<std::mutex> call(m_callMutex);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_job = &fn;
+        m_count = count;
+        m_next = 0;
+        m_active = m_workers.size();
+        m_generation++;
+    }
+    m_wake.notify_all();
+    RunJob(fn, count);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [this]() { return m_active == 0; });
+    m_job = nullptr;
+}
+
+void ThreadPool::WorkerLoop()
+{
+    uint64_t generation = 0;
+    for (;;) {
+        const std::function<void(size_t)>* job;
+        size_t count;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [&]() { return m_bStop || m_generation != generation; });
+            if (m_bStop) {
+                return;
+            }
+            generation = m_generation;
+            job = m_job;
+            count = m_count;
+        }
+        RunJob(*job, count);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (--m_active == 0) {
+                m_done.notify_one();
+            }
+        }
+    }
+}
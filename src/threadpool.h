@@ -0,0 +1,43 @@
+#ifndef  __TUXDUMP_THREADPOOL_H__
+#define  __TUXDUMP_THREADPOOL_H__
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Fixed set of worker threads for data-parallel loops.  The calling thread
+ * takes part in the work, so a pool of size 1 runs everything inline.
+ * ParallelFor must not be called from inside a job.
+ */
+class ThreadPool {
+    public:
+        explicit ThreadPool(size_t threads = 0);
+        ~ThreadPool();
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        size_t GetSize() const { return m_workers.size() + 1; }
+        void ParallelFor(size_t count, const std::function<void(size_t)>& fn);
+    private:
+        void WorkerLoop();
+        void RunJob(const std::function<void(size_t)>& fn, size_t count);
+    private:
+        std::vector<std::thread> m_workers;
+        std::mutex m_callMutex;
+        std::mutex m_mutex;
+        std::condition_variable m_wake;
+        std::condition_variable m_done;
+        const std::function<void(size_t)>* m_job = nullptr;
+        size_t m_count = 0;
+        std::atomic<size_t> m_next{0};
+        size_t m_active = 0;
+        uint64_t m_generation = 0;
+        bool m_bStop = false;
+};
+
+#endif //__TUXDUMP_THREADPOOL_H__
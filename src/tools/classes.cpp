@@ -0,0 +1,385 @@
+#include "tools.h"
+#include "../elfmodule.h"
+#include "../logger.h"
+#include "../scanner.h"
+#include "../stats.h"
+
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <cxxabi.h>
+#include <sys/mman.h>
+
+#include <rapidjson/prettywriter.h>
+#include <rapidjson/stringbuffer.h>
+
+static const size_t CHUNK_SIZE = 64 * 1024;
+static const size_t MAX_NAME = 512;
+static const size_t MAX_BASES = 64;
+static const int64_t MAX_TOP_OFFSET = 1 << 20;
+
+namespace {
+
+/**
+ * A vtable as found in memory: address is the address point (the first
+ * virtual function), top the offset-to-top stored two words before it.
+ * Type infos outside the module (emitted by whoever else used the type)
+ * are only checked after the scan.
+ */
+struct Vtable {
+    uintptr_t address;
+    uintptr_t typeinfo;
+    int64_t top;
+    size_t methods;
+    bool bVerified;
+};
+
+enum class TypeKind {
+    Class,          // __class_type_info, no bases
+    Single,         // __si_class_type_info, one base at offset 0
+    Multiple        // __vmi_class_type_info, a counted list of bases
+};
+
+/**
+ * The cached image of a module plus the checks the scan needs.  Pointers
+ * outside the module are validated against the region index and read
+ * from the memory source.
+ */
+class ModuleView {
+    public:
+        ModuleView(MemorySource& mem, const Region* module, const uint8_t* data)
+            : m_mem(mem), m_module(module), m_data(data) {}
+        bool Contains(uintptr_t address, size_t size) const
+        {
+            return address >= m_module->start && address <= m_module->end
+                    && size <= m_module->end - address;
+        }
+        uint64_t Read64(uintptr_t address) const
+        {
+            uint64_t value;
+            memcpy(&value, m_data + (address - m_module->start), sizeof(value));
+            return value;
+        }
+        bool ReadAny64(uintptr_t address, uint64_t& value) const
+        {
+            if (Contains(address, sizeof(value))) {
+                value = Read64(address);
+                return true;
+            }
+            return m_mem.ReadChecked(address, value);
+        }
+        bool IsCode(uintptr_t address) const
+        {
+            const Region* region = m_mem.FindRegion(address);
+            return region && (region->perms & (PROT_READ | PROT_EXEC)) == (PROT_READ | PROT_EXEC);
+        }
+        bool IsData(uintptr_t address) const
+        {
+            const Region* region = m_mem.FindRegion(address);
+            return region && (region->perms & (PROT_READ | PROT_EXEC)) == PROT_READ;
+        }
+        bool GetTypeName(uintptr_t typeinfo, std::string& name, bool bLocal) const;
+    private:
+        MemorySource& m_mem;
+        const Region* m_module;
+        const uint8_t* m_data;
+};
+
+}
+
+/**
+ * Mangled type names are identifiers and digits, GCC marks types with
+ * internal linkage with a leading '*'.
+ */
+static bool IsTypeName(const char* name, size_t size)
+{
+    if (*name == '*') {
+        name++;
+        size--;
+    }
+    if (!size || !(isdigit(*name) || *name == 'N' || *name == 'S' || *name == 'Z')) {
+        return false;
+    }
+    for (size_t i = 0; i < size; ++i) {
+        if (!isalnum(static_cast<unsigned char>(name[i])) && name[i] != '_') {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Reads the name of a type_info object.  With bLocal only objects inside
+ * the module are considered, which keeps the parallel scan free of reads.
+ */
+bool ModuleView::GetTypeName(uintptr_t typeinfo, std::string& name, bool bLocal) const
+{
+    uint64_t fields[2];
+    if (typeinfo % sizeof(uint64_t)) {
+        return false;
+    }
+    if (Contains(typeinfo, sizeof(fields))) {
+        fields[0] = Read64(typeinfo);
+        fields[1] = Read64(typeinfo + 8);
+    } else if (bLocal || !m_mem.ReadChecked(typeinfo, fields)) {
+        return false;
+    }
+    if (!fields[0] || !m_mem.FindRegion(fields[0])) {
+        return false;
+    }
+
+    char buffer[MAX_NAME];
+    size_t size;
+    if (Contains(fields[1], 1)) {
+        const char* text = reinterpret_cast<const char*>(m_data + (fields[1] - m_module->start));
+        size = strnlen(text, std::min<size_t>(sizeof(buffer), m_module->end - fields[1]));
+        memcpy(buffer, text, size);
+    } else if (bLocal || !m_mem.ReadString(fields[1], buffer, sizeof(buffer))) {
+        return false;
+    } else {
+        size = strlen(buffer);
+    }
+    if (size >= sizeof(buffer) || !IsTypeName(buffer, size)) {
+        return false;
+    }
+    name.assign(buffer[0] == '*' ? buffer + 1 : buffer, buffer[0] == '*' ? size - 1 : size);
+    return true;
+}
+
+/**
+ * Number of virtual function slots at address.  Abstract classes leave
+ * their destructor slots null, so up to two nulls count when code follows.
+ */
+static size_t CountMethods(const ModuleView& view, uintptr_t address, uintptr_t limit)
+{
+    size_t methods = 0;
+    size_t nulls = 0;
+    for (uintptr_t slot = address; slot + 8 <= limit; slot += 8) {
+        uint64_t value = view.Read64(slot);
+        if (!value && nulls < 2) {
+            nulls++;
+        } else if (value && view.IsCode(value)) {
+            methods += nulls + 1;
+            nulls = 0;
+        } else {
+            break;
+        }
+    }
+    return methods;
+}
+
+/**
+ * Every word pair (offset-to-top, typeinfo) in [begin, end) that is
+ * followed by virtual function slots.
+ */
+static void ScanChunk(const ModuleView& view, uintptr_t begin, uintptr_t end, uintptr_t limit,
+        std::vector<Vtable>& vtables)
+{
+    std::string name;
+    for (uintptr_t at = begin; at < end && at + 24 <= limit; at += sizeof(uint64_t)) {
+        int64_t top = static_cast<int64_t>(view.Read64(at));
+        if (top > 0 || top <= -MAX_TOP_OFFSET) {
+            continue;
+        }
+        uintptr_t typeinfo = view.Read64(at + 8);
+        bool bLocal = view.Contains(typeinfo, 16);
+        if (!bLocal && (typeinfo % sizeof(uint64_t) || !view.IsData(typeinfo))) {
+            continue;
+        }
+        Vtable vtable = {at + 16, typeinfo, top, CountMethods(view, at + 16, limit), bLocal};
+        if (!vtable.methods || (bLocal && !view.GetTypeName(typeinfo, name, true))) {
+            continue;
+        }
+        vtables.push_back(vtable);
+        at = vtable.address + vtable.methods * 8 - sizeof(uint64_t);
+    }
+}
+
+static TypeKind Classify(const ModuleView& view, const std::vector<uintptr_t>& typeinfos)
+{
+    // Each flavour of type_info shares one vtable, so decide per vtable
+    // over all objects using it
+    std::string name;
+    bool bSingle = true;
+    bool bMultiple = true;
+    for (uintptr_t typeinfo : typeinfos) {
+        uint64_t field;
+        if (!view.ReadAny64(typeinfo + 16, field)) {
+            return TypeKind::Class;
+        }
+        bSingle = bSingle && view.GetTypeName(field, name, false);
+        uint32_t flags = static_cast<uint32_t>(field);
+        uint32_t count = static_cast<uint32_t>(field >> 32);
+        uint64_t base;
+        bMultiple = bMultiple && flags <= 3 && count && count <= MAX_BASES
+                && view.ReadAny64(typeinfo + 24, base) && view.GetTypeName(base, name, false);
+        if (!bSingle && !bMultiple) {
+            return TypeKind::Class;
+        }
+    }
+    return bSingle ? TypeKind::Single : TypeKind::Multiple;
+}
+
+static std::string Demangle(const std::string& mangled)
+{
+    int status;
+    char* demangled = abi::__cxa_demangle(mangled.c_str(), nullptr, nullptr, &status);
+    if (!demangled) {
+        return mangled;
+    }
+    std::string name = demangled;
+    free(demangled);
+    return name;
+}
+
+static void DumpModule(Context& ctx, Scanner& scanner, const Region* module,
+        rapidjson::PrettyWriter<rapidjson::StringBuffer>& writer)
+{
+    MemorySource& mem = ctx.GetMemory();
+    ModuleView view(mem, module, scanner.GetModuleData(module));
+
+    // Vtables live in .data.rel.ro, without program headers scan all data
+    std::vector<std::pair<uintptr_t, uintptr_t>> ranges;
+    ElfModule elf;
+    uintptr_t start;
+    uintptr_t end;
+    if (elf.Load(mem, module) && elf.GetRelro(start, end) && view.Contains(start, end - start)) {
+        ranges.push_back({start & ~static_cast<uintptr_t>(7), end});
+    } else {
+        for (const Region& region : mem.GetRegions()) {
+            if (region.start >= module->start && region.end <= module->end
+                    && (region.perms & PROT_READ) && !(region.perms & PROT_EXEC)) {
+                ranges.push_back({region.start, region.end});
+            }
+        }
+    }
+
+    struct Chunk {
+        uintptr_t begin;
+        uintptr_t end;
+        uintptr_t limit;
+        std::vector<Vtable> vtables;
+    };
+    std::vector<Chunk> chunks;
+    ScopedPhase phase(&ctx.GetStats(), "ScanVtables", module->name);
+    for (const std::pair<uintptr_t, uintptr_t>& range : ranges) {
+        phase.AddBytes(range.second - range.first);
+        for (uintptr_t begin = range.first; begin < range.second; begin += CHUNK_SIZE) {
+            chunks.push_back({begin, std::min(begin + CHUNK_SIZE, range.second), range.second, {}});
+        }
+    }
+    ctx.GetPool().ParallelFor(chunks.size(), [&](size_t i) {
+        ScanChunk(view, chunks[i].begin, chunks[i].end, chunks[i].limit, chunks[i].vtables);
+    });
+
+    // One entry per type, its primary vtable is the first with offset-to-top 0
+    std::map<uintptr_t, Vtable> primary;
+    std::string name;
+    for (const Chunk& chunk : chunks) {
+        for (const Vtable& vtable : chunk.vtables) {
+            if (!vtable.top && !primary.count(vtable.typeinfo)
+                    && (vtable.bVerified || view.GetTypeName(vtable.typeinfo, name, false))) {
+                primary[vtable.typeinfo] = vtable;
+            }
+        }
+    }
+
+    std::map<uint64_t, std::vector<uintptr_t>> flavours;
+    for (const std::pair<const uintptr_t, Vtable>& entry : primary) {
+        uint64_t flavour = 0;
+        view.ReadAny64(entry.first, flavour);
+        flavours[flavour].push_back(entry.first);
+    }
+    std::map<uint64_t, TypeKind> kinds;
+    for (const std::pair<const uint64_t, std::vector<uintptr_t>>& flavour : flavours) {
+        kinds[flavour.first] = Classify(view, flavour.second);
+    }
+    phase.Stop();
+
+    std::map<std::string, const Vtable*> classes;
+    for (const std::pair<const uintptr_t, Vtable>& entry : primary) {
+        view.GetTypeName(entry.first, name, false);
+        std::string className = Demangle(name);
+        if (ctx.GetFilter().Matches(className.c_str())) {
+            classes[className] = &entry.second;
+        }
+    }
+    Logger::Debug("{}: {} vtables, {} classes", module->name, primary.size(), classes.size());
+
+    writer.Key(module->name);
+    writer.StartObject();
+    for (const std::pair<const std::string, const Vtable*>& entry : classes) {
+        const Vtable& vtable = *entry.second;
+        writer.Key(entry.first.c_str());
+        writer.StartObject();
+        writer.Key("vtable");
+        writer.Uint64(vtable.address - module->start);
+        writer.Key("methods");
+        writer.Uint64(vtable.methods);
+
+        // Direct bases and their offset in the class, 0 for virtual bases
+        writer.Key("bases");
+        writer.StartObject();
+        uint64_t flavour = 0;
+        view.ReadAny64(vtable.typeinfo, flavour);
+        TypeKind kind = kinds[flavour];
+        uint64_t field = 0;
+        view.ReadAny64(vtable.typeinfo + 16, field);
+        size_t count = kind == TypeKind::Single ? 1 : kind == TypeKind::Multiple ? field >> 32 : 0;
+        for (size_t i = 0; i < count; ++i) {
+            uint64_t base = field;
+            uint64_t offsetFlags = 0;
+            if (kind == TypeKind::Multiple && (!view.ReadAny64(vtable.typeinfo + 24 + i * 16, base)
+                    || !view.ReadAny64(vtable.typeinfo + 32 + i * 16, offsetFlags))) {
+                break;
+            }
+            if (view.GetTypeName(base, name, false)) {
+                bool bVirtual = offsetFlags & 1;
+                writer.Key(Demangle(name).c_str());
+                writer.Uint64(bVirtual ? 0 : static_cast<int64_t>(offsetFlags) >> 8);
+            }
+        }
+        writer.EndObject();
+        writer.EndObject();
+    }
+    writer.EndObject();
+}
+
+std::string Tools::ScanClasses(Context& ctx)
+{
+    MemorySource& mem = ctx.GetMemory();
+    std::set<std::string> modules;
+    for (const libconfig::Setting& entry : ctx.GetConfig().lookup("signatures")) {
+        if (entry.exists("region")) {
+            modules.insert(static_cast<const char*>(entry.lookup("region")));
+        }
+    }
+
+    Scanner scanner(mem);
+    rapidjson::StringBuffer data;
+    rapidjson::PrettyWriter<rapidjson::StringBuffer> writer(data);
+    writer.StartObject();
+    for (const std::string& name : modules) {
+        const Region* module = mem.GetRegion(name.c_str());
+        if (!module) {
+            Logger::Debug("{}: module not found", name);
+            continue;
+        }
+        DumpModule(ctx, scanner, module, writer);
+    }
+    writer.EndObject();
+    return data.GetString();
+}
+
+void Tools::DumpClasses(Context& ctx, Formatter& fmt)
+{
+    std::string json = ScanClasses(ctx);
+    ScopedPhase phase(&ctx.GetStats(), "Print", "classes");
+    phase.AddBytes(json.size());
+    fmt.Print(json, "classes");
+}
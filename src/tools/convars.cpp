@@ -0,0 +1,354 @@
+#include "tools.h"
+#include "../interfaces.h"
+#include "../logger.h"
+#include "../scanner.h"
+#include "../stats.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <sys/mman.h>
+
+#include <rapidjson/prettywriter.h>
+#include <rapidjson/stringbuffer.h>
+
+static const uintptr_t CACHE_PAGE = 4096;
+static const size_t MAX_NAME = 128;
+static const size_t MAX_VALUE = 256;
+static const size_t MAX_NODES = 1 << 16;
+static const size_t LIST_SLOTS = 32;
+static const size_t LIST_CHECK_DEPTH = 3;
+
+class ConCommandBase {
+    public:
+        uintptr_t m_pVTable;
+        uintptr_t m_pNext;
+        bool m_bRegistered;
+    private:
+        uint8_t pad0[7];
+    public:
+        uintptr_t m_pszName;
+        uintptr_t m_pszHelpString;
+        int m_nFlags;
+    private:
+        uint8_t pad1[4];
+};
+
+/**
+ * ConVar adds IConVar and its own fields after the base; ConCommand puts
+ * its callbacks in the same place, so m_pParent tells them apart: a
+ * ConVar's parent is itself or another registered ConVar.
+ */
+class ConVar : public ConCommandBase {
+    public:
+        uintptr_t m_pIConVarVTable;
+        uintptr_t m_pParent;
+        uintptr_t m_pszDefaultValue;
+};
+
+namespace {
+
+/**
+ * Whole pages of the target, read once.  ConCommandBase objects are
+ * mostly globals packed into a few data pages and their strings share
+ * rodata pages, so thousands of nodes cost a few hundred reads, and all
+ * pages missing at once are fetched in a single vectored read.
+ */
+class PageCache {
+    public:
+        explicit PageCache(MemorySource& mem) : m_mem(mem) {}
+        void Fetch(const std::vector<std::pair<uintptr_t, size_t>>& ranges);
+        bool Read(uintptr_t address, void* buffer, size_t size);
+        bool ReadString(uintptr_t address, std::string& text, size_t size);
+    private:
+        MemorySource& m_mem;
+        std::unordered_map<uintptr_t, std::vector<uint8_t>> m_pages;
+};
+
+struct Node {
+    uintptr_t address;
+    ConVar data;
+};
+
+}
+
+void PageCache::Fetch(const std::vector<std::pair<uintptr_t, size_t>>& ranges)
+{
+    std::vector<uintptr_t> missing;
+    std::unordered_set<uintptr_t> queued;
+    for (const std::pair<uintptr_t, size_t>& range : ranges) {
+        if (!range.first || range.second > UINTPTR_MAX - range.first) {
+            continue;
+        }
+        uintptr_t last = (range.first + range.second - 1) & ~(CACHE_PAGE - 1);
+        for (uintptr_t page = range.first & ~(CACHE_PAGE - 1); page <= last; page += CACHE_PAGE) {
+            if (!m_pages.count(page) && queued.insert(page).second) {
+                missing.push_back(page);
+            }
+        }
+    }
+    if (missing.empty()) {
+        return;
+    }
+
+    std::vector<ReadOp> ops;
+    for (uintptr_t page : missing) {
+        std::vector<uint8_t>& data = m_pages[page];
+        data.resize(m_mem.GetReadableSize(page, CACHE_PAGE));
+        if (!data.empty()) {
+            ops.push_back({page, data.data(), data.size(), 0});
+        }
+    }
+    m_mem.ReadCheckedV(ops.data(), ops.size());
+    for (const ReadOp& op : ops) {
+        if (op.result != static_cast<ssize_t>(op.size)) {
+            m_pages[op.address].clear();
+        }
+    }
+}
+
+bool PageCache::Read(uintptr_t address, void* buffer, size_t size)
+{
+    Fetch({{address, size}});
+    uint8_t* out = static_cast<uint8_t*>(buffer);
+    while (size) {
+        uintptr_t page = address & ~(CACHE_PAGE - 1);
+        const std::vector<uint8_t>& data = m_pages[page];
+        size_t offset = address - page;
+        if (offset >= data.size()) {
+            return false;
+        }
+        size_t chunk = std::min(size, data.size() - offset);
+        memcpy(out, data.data() + offset, chunk);
+        out += chunk;
+        address += chunk;
+        size -= chunk;
+    }
+    return true;
+}
+
+/**
+ * The C string at address, false unless it ends within size bytes.  The
+ * pages have to be fetched already.
+ */
+bool PageCache::ReadString(uintptr_t address, std::string& text, size_t size)
+{
+    text.clear();
+    while (text.size() < size) {
+        uintptr_t page = address & ~(CACHE_PAGE - 1);
+        auto it = m_pages.find(page);
+        if (it == m_pages.end() || address - page >= it->second.size()) {
+            return false;
+        }
+        const uint8_t* begin = it->second.data() + (address - page);
+        const uint8_t* end = it->second.data() + it->second.size();
+        const uint8_t* nul = std::find(begin, end, 0);
+        text.append(begin, nul);
+        if (nul != end) {
+            return text.size() < size;
+        }
+        address += end - begin;
+    }
+    return false;
+}
+
+static bool IsConVarName(const std::string& name)
+{
+    if (name.empty()) {
+        return false;
+    }
+    for (char c : name) {
+        if (!isalnum(static_cast<unsigned char>(c)) && !strchr("_+-.", c)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * A few nodes from head on with a vtable in a read-only mapping and a
+ * readable name: what a ConCommandBase list looks like, and what the
+ * other members of CCvar do not.
+ */
+static bool IsCommandList(MemorySource& mem, PageCache& cache, uintptr_t head)
+{
+    uintptr_t node = head;
+    for (size_t depth = 0; depth < LIST_CHECK_DEPTH && node; ++depth) {
+        ConCommandBase base;
+        std::string name;
+        if (!cache.Read(node, &base, sizeof(base))) {
+            return false;
+        }
+        const Region* vtable = mem.FindRegion(base.m_pVTable);
+        if (!vtable || !(vtable->perms & PROT_READ) || (vtable->perms & (PROT_WRITE | PROT_EXEC))) {
+            return false;
+        }
+        cache.Fetch({{base.m_pszName, MAX_NAME}});
+        if (!cache.ReadString(base.m_pszName, name, MAX_NAME) || !IsConVarName(name)) {
+            return false;
+        }
+        node = base.m_pNext;
+    }
+    return true;
+}
+
+/**
+ * The head of CCvar's ConCommandBase list.  Its offset differs between
+ * engine branches, so the first pointer-sized members are probed instead.
+ */
+static uintptr_t FindCommandList(MemorySource& mem, PageCache& cache, uintptr_t cvar)
+{
+    uintptr_t slots[LIST_SLOTS];
+    if (!cache.Read(cvar, slots, sizeof(slots))) {
+        return 0;
+    }
+    for (size_t i = 1; i < LIST_SLOTS; ++i) {
+        if (slots[i] && IsCommandList(mem, cache, slots[i])) {
+            Logger::Debug("ConCommandBase list at CCvar+{:#x}", i * sizeof(uintptr_t));
+            return slots[i];
+        }
+    }
+    return 0;
+}
+
+static uintptr_t GetCvar(Context& ctx, Scanner& scanner)
+{
+    InterfaceRegistry registry;
+    {
+        ScopedPhase phase(&ctx.GetStats(), "Interfaces", "convars");
+        registry.Build(ctx.GetMemory(), scanner, ctx.GetPool());
+    }
+    const InterfaceRegistry::Module* module = nullptr;
+    const InterfaceRegistry::Interface* cvar = registry.Find("VEngineCvar", &module);
+    if (!cvar) {
+        Logger::Error("No module registers VEngineCvar");
+        return 0;
+    }
+    if (!module->bIs64) {
+        Logger::Error("{}: 32-bit modules are not supported", module->region->name);
+        return 0;
+    }
+    uintptr_t instance = InterfaceRegistry::GetInstance(scanner, cvar->factory);
+    if (!instance) {
+        Logger::Error("{}: {} has no static instance", module->region->name, cvar->name);
+    }
+    Logger::Debug("{} at {:#x} in {}", cvar->name, instance, module->region->name);
+    return instance;
+}
+
+/**
+ * The module an object belongs to, counting the anonymous mapping right
+ * after a module as its .bss.
+ */
+static const Region* FindModule(MemorySource& mem, uintptr_t address)
+{
+    const Region* region = mem.FindRegion(address);
+    if (!region) {
+        return nullptr;
+    }
+    for (const Region& module : mem.GetModules()) {
+        if ((address >= module.start && address < module.end) || (!*region->path && region->start == module.end)) {
+            return &module;
+        }
+    }
+    return nullptr;
+}
+
+std::string Tools::ScanConvars(Context& ctx)
+{
+    MemorySource& mem = ctx.GetMemory();
+    Scanner scanner(mem);
+    PageCache cache(mem);
+    std::vector<Node> nodes;
+    {
+        uintptr_t cvar = GetCvar(ctx, scanner);
+        ScopedPhase phase(&ctx.GetStats(), "ConvarWalk");
+        uintptr_t address = cvar ? FindCommandList(mem, cache, cvar) : 0;
+        std::unordered_set<uintptr_t> visited;
+        while (address && nodes.size() < MAX_NODES && visited.insert(address).second) {
+            Node node;
+            node.address = address;
+            if (!cache.Read(address, &node.data, sizeof(node.data))) {
+                Logger::Debug("unreadable ConCommandBase at {:#x}", address);
+                break;
+            }
+            nodes.push_back(node);
+            address = node.data.m_pNext;
+        }
+        Logger::Debug("{} ConCommandBase nodes", nodes.size());
+    }
+
+    // ConVars and the strings of every node, their pages in one batch
+    std::unordered_set<uintptr_t> addresses;
+    for (const Node& node : nodes) {
+        addresses.insert(node.address);
+    }
+    std::vector<bool> bConVar(nodes.size());
+    std::vector<std::pair<uintptr_t, size_t>> strings;
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        const ConVar& data = nodes[i].data;
+        bConVar[i] = data.m_pParent == nodes[i].address || addresses.count(data.m_pParent);
+        strings.push_back({data.m_pszName, MAX_NAME});
+        if (bConVar[i]) {
+            strings.push_back({data.m_pszDefaultValue, MAX_VALUE});
+        }
+    }
+    {
+        ScopedPhase phase(&ctx.GetStats(), "ConvarStrings");
+        cache.Fetch(strings);
+    }
+
+    std::map<std::string, std::map<std::string, size_t>> sorted;
+    const NameFilter& filter = ctx.GetFilter();
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        std::string name;
+        if (!cache.ReadString(nodes[i].data.m_pszName, name, MAX_NAME) || !filter.Matches(name.c_str())) {
+            continue;
+        }
+        const Region* module = FindModule(mem, nodes[i].address);
+        sorted[module ? module->name : "[heap]"].emplace(name, i);
+    }
+
+    rapidjson::StringBuffer data;
+    rapidjson::PrettyWriter<rapidjson::StringBuffer> writer(data);
+    writer.StartObject();
+    for (const auto& module : sorted) {
+        writer.Key(module.first.c_str());
+        writer.StartObject();
+        for (const auto& it : module.second) {
+            const Node& node = nodes[it.second];
+            const Region* region = FindModule(mem, node.address);
+            writer.Key(it.first.c_str());
+            writer.StartObject();
+            writer.Key("flags");
+            writer.Uint(static_cast<unsigned int>(node.data.m_nFlags));
+            if (region) {
+                writer.Key("offset");
+                writer.Uint64(node.address - region->start);
+            }
+            std::string value;
+            if (bConVar[it.second] && cache.ReadString(node.data.m_pszDefaultValue, value, MAX_VALUE)) {
+                writer.Key("default");
+                writer.String(value.c_str());
+            }
+            writer.EndObject();
+        }
+        writer.EndObject();
+    }
+    writer.EndObject();
+    return data.GetString();
+}
+
+void Tools::DumpConvars(Context& ctx, Formatter& fmt)
+{
+    std::string json = ScanConvars(ctx);
+    ScopedPhase phase(&ctx.GetStats(), "Print", "convars");
+    phase.AddBytes(json.size());
+    fmt.Print(json, "convars");
+}
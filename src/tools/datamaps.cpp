@@ -0,0 +1,361 @@
+#include "tools.h"
+#include "../logger.h"
+#include "../scanner.h"
+#include "../stats.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <map>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/mman.h>
+
+#include <rapidjson/prettywriter.h>
+#include <rapidjson/stringbuffer.h>
+
+static const size_t CHUNK_SIZE = 64 * 1024;
+static const size_t MAX_NAME = 128;
+static const int MAX_FIELDS = 4096;
+static const size_t MAX_EMBED_DEPTH = 8;
+
+enum class FieldType : int {
+    FIELD_VOID = 0,
+    FIELD_EMBEDDED = 10,
+    FIELD_INPUT = 20,
+    FIELD_FUNCTION = 21,
+    FIELD_TYPECOUNT = 31
+};
+
+class TypeDescription {
+    public:
+        FieldType fieldType;
+    private:
+        uint8_t pad0[4];
+    public:
+        uintptr_t fieldName; // const char*
+        int fieldOffset;
+        unsigned short fieldSize;
+        short flags;
+        uintptr_t externalName;
+        uintptr_t pSaveRestoreOps;
+        uintptr_t inputFunc[2]; // pointer to member function
+        uintptr_t td; // datamap_t*
+        int fieldSizeInBytes;
+    private:
+        uint8_t pad1[4];
+    public:
+        uintptr_t override_field;
+        int override_count;
+        float fieldTolerance;
+        int flatOffset[2];
+        unsigned short flatGroup;
+    private:
+        uint8_t pad2[6];
+};
+
+class DataMap {
+    public:
+        uintptr_t dataDesc; // typedescription_t*
+        int dataNumFields;
+    private:
+        uint8_t pad0[4];
+    public:
+        uintptr_t dataClassName; // const char*
+        uintptr_t baseMap; // datamap_t*
+};
+
+static_assert(sizeof(TypeDescription) == 0x68, "typedescription_t layout");
+static_assert(sizeof(DataMap) == 0x20, "datamap_t layout");
+
+namespace {
+
+struct Field {
+    std::string name;
+    int offset;
+    int type;
+    int size;
+};
+
+struct ClassMap {
+    std::string name;
+    uintptr_t baseMap;
+};
+
+/**
+ * Reads datamaps and flattens embedded ones into their parent.  Every map
+ * is read once: the fields of a base or embedded map shared by hundreds of
+ * classes are kept by address.
+ */
+class DataMapWalker {
+    public:
+        DataMapWalker(MemorySource& mem, Scanner& scanner) : m_mem(mem), m_scanner(scanner) {}
+        bool ReadMap(uintptr_t address, DataMap& map, std::string& name);
+        std::vector<Field> GetFields(uintptr_t address, size_t depth = 0);
+    private:
+        bool ReadString(uintptr_t address, std::string& text);
+    private:
+        MemorySource& m_mem;
+        Scanner& m_scanner;
+        std::unordered_map<uintptr_t, std::vector<Field>> m_fields;
+};
+
+}
+
+static bool IsIdentifier(const char* text, size_t size)
+{
+    if (!size || !(isalpha(static_cast<unsigned char>(*text)) || *text == '_')) {
+        return false;
+    }
+    for (size_t i = 0; i < size; ++i) {
+        if (!isalnum(static_cast<unsigned char>(text[i])) && text[i] != '_') {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool DataMapWalker::ReadString(uintptr_t address, std::string& text)
+{
+    char buffer[MAX_NAME];
+    size_t size = address ? m_mem.GetReadableSize(address, sizeof(buffer)) : 0;
+    if (!size || !m_scanner.Read(address, buffer, size)) {
+        return false;
+    }
+    size_t length = strnlen(buffer, size);
+    if (length == size) {
+        return false;
+    }
+    text.assign(buffer, length);
+    return true;
+}
+
+bool DataMapWalker::ReadMap(uintptr_t address, DataMap& map, std::string& name)
+{
+    return m_scanner.Read(address, &map, sizeof(map)) && map.dataNumFields > 0
+            && map.dataNumFields <= MAX_FIELDS && ReadString(map.dataClassName, name);
+}
+
+std::vector<Field> DataMapWalker::GetFields(uintptr_t address, size_t depth)
+{
+    auto it = m_fields.find(address);
+    if (it != m_fields.end()) {
+        return it->second;
+    }
+    // Inserted up front so a map embedding itself ends the recursion
+    m_fields[address];
+
+    DataMap map;
+    std::string name;
+    std::vector<TypeDescription> descs;
+    if (!ReadMap(address, map, name)) {
+        return {};
+    }
+    descs.resize(map.dataNumFields);
+    if (!m_scanner.Read(map.dataDesc, descs.data(), descs.size() * sizeof(TypeDescription))) {
+        Logger::Debug("{}: unreadable typedescription_t array at {:#x}", name, map.dataDesc);
+        return {};
+    }
+
+    std::vector<Field> fields;
+    for (const TypeDescription& desc : descs) {
+        std::string fieldName;
+        if (desc.fieldType == FieldType::FIELD_VOID || desc.fieldType == FieldType::FIELD_INPUT
+                || desc.fieldType == FieldType::FIELD_FUNCTION || desc.fieldOffset < 0
+                || !ReadString(desc.fieldName, fieldName)) {
+            continue;
+        }
+        fields.push_back({fieldName, desc.fieldOffset, static_cast<int>(desc.fieldType), desc.fieldSizeInBytes});
+        if (desc.fieldType == FieldType::FIELD_EMBEDDED && desc.td && depth < MAX_EMBED_DEPTH) {
+            for (const Field& embedded : GetFields(desc.td, depth + 1)) {
+                fields.push_back({fieldName + "." + embedded.name, desc.fieldOffset + embedded.offset,
+                        embedded.type, embedded.size});
+            }
+        }
+    }
+    m_fields[address] = fields;
+    return fields;
+}
+
+/**
+ * A datamap_t in the module's image: its fields and class name inside the
+ * module, a plausible field count and typedescription_t entries with
+ * known types.  Everything is checked against the image, no reads.
+ */
+static bool IsDataMap(const Region* module, const uint8_t* image, uintptr_t address)
+{
+    auto contains = [module](uintptr_t pointer, size_t size) {
+        return pointer >= module->start && pointer <= module->end && size <= module->end - pointer;
+    };
+    DataMap map;
+    memcpy(&map, image + (address - module->start), sizeof(map));
+    if (map.dataNumFields <= 0 || map.dataNumFields > MAX_FIELDS || map.dataDesc % sizeof(uintptr_t)
+            || map.baseMap % sizeof(uintptr_t)
+            || !contains(map.dataDesc, map.dataNumFields * sizeof(TypeDescription))
+            || !contains(map.dataClassName, 1)) {
+        return false;
+    }
+
+    const char* name = reinterpret_cast<const char*>(image + (map.dataClassName - module->start));
+    size_t available = std::min(MAX_NAME, static_cast<size_t>(module->end - map.dataClassName));
+    size_t length = strnlen(name, available);
+    if (length == available || !IsIdentifier(name, length)) {
+        return false;
+    }
+
+    for (int i = 0; i < map.dataNumFields; ++i) {
+        TypeDescription desc;
+        memcpy(&desc, image + (map.dataDesc - module->start) + i * sizeof(desc), sizeof(desc));
+        if (static_cast<unsigned int>(desc.fieldType) >= static_cast<unsigned int>(FieldType::FIELD_TYPECOUNT)
+                || (desc.fieldName && !contains(desc.fieldName, 1))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Every datamap_t starting in [begin, end).  The last ones may reach past
+ * end, up to limit.
+ */
+static void ScanChunk(const Region* module, const uint8_t* image, uintptr_t begin, uintptr_t end,
+        uintptr_t limit, std::vector<uintptr_t>& maps)
+{
+    for (uintptr_t address = begin; address < end && address + sizeof(DataMap) <= limit;
+            address += sizeof(uintptr_t)) {
+        if (IsDataMap(module, image, address)) {
+            maps.push_back(address);
+        }
+    }
+}
+
+/**
+ * Datamaps are initialised globals, so only the writable mappings of the
+ * module are scanned.  Base maps are followed from there, which also
+ * picks up bases defined in other modules.
+ */
+static void DumpModule(Context& ctx, Scanner& scanner, DataMapWalker& walker, const Region* module,
+        std::map<uintptr_t, ClassMap>& maps, std::map<std::string, uintptr_t>& classes)
+{
+    MemorySource& mem = ctx.GetMemory();
+    const uint8_t* image = scanner.GetModuleData(module);
+    if (!image) {
+        return;
+    }
+
+    struct Chunk {
+        uintptr_t begin;
+        uintptr_t end;
+        uintptr_t limit;
+        std::vector<uintptr_t> maps;
+    };
+    std::vector<Chunk> chunks;
+    ScopedPhase phase(&ctx.GetStats(), "ScanDataMaps", module->name);
+    for (const Region& region : mem.GetRegions()) {
+        if (region.start < module->start || region.end > module->end
+                || (region.perms & (PROT_READ | PROT_WRITE | PROT_EXEC)) != (PROT_READ | PROT_WRITE)) {
+            continue;
+        }
+        phase.AddBytes(region.end - region.start);
+        for (uintptr_t begin = region.start; begin < region.end; begin += CHUNK_SIZE) {
+            chunks.push_back({begin, std::min(begin + CHUNK_SIZE, region.end), region.end, {}});
+        }
+    }
+    ctx.GetPool().ParallelFor(chunks.size(), [&](size_t i) {
+        ScanChunk(module, image, chunks[i].begin, chunks[i].end, chunks[i].limit, chunks[i].maps);
+    });
+    phase.Stop();
+
+    std::vector<uintptr_t> pending;
+    for (const Chunk& chunk : chunks) {
+        pending.insert(pending.end(), chunk.maps.begin(), chunk.maps.end());
+    }
+    size_t found = pending.size();
+    while (!pending.empty()) {
+        uintptr_t address = pending.back();
+        pending.pop_back();
+        DataMap map;
+        std::string name;
+        if (maps.count(address) || !walker.ReadMap(address, map, name)) {
+            continue;
+        }
+        maps[address] = {name, map.baseMap};
+        classes.emplace(name, address);
+        if (map.baseMap) {
+            pending.push_back(map.baseMap);
+        }
+    }
+    Logger::Debug("{}: {} datamaps", module->name, found);
+}
+
+std::string Tools::ScanDataMaps(Context& ctx)
+{
+    MemorySource& mem = ctx.GetMemory();
+    std::set<std::string> modules;
+    for (const libconfig::Setting& entry : ctx.GetConfig().lookup("signatures")) {
+        if (entry.exists("region")) {
+            modules.insert(static_cast<const char*>(entry.lookup("region")));
+        }
+    }
+
+    Scanner scanner(mem);
+    DataMapWalker walker(mem, scanner);
+    std::map<uintptr_t, ClassMap> maps;
+    std::map<std::string, uintptr_t> classes;
+    for (const std::string& name : modules) {
+        const Region* module = mem.GetRegion(name.c_str());
+        if (!module) {
+            Logger::Debug("{}: module not found", name);
+            continue;
+        }
+        DumpModule(ctx, scanner, walker, module, maps, classes);
+    }
+
+    rapidjson::StringBuffer data;
+    rapidjson::PrettyWriter<rapidjson::StringBuffer> writer(data);
+    writer.StartObject();
+    const NameFilter& filter = ctx.GetFilter();
+    ScopedPhase phase(&ctx.GetStats(), "DataMapWalk");
+    for (const std::pair<const std::string, uintptr_t>& entry : classes) {
+        if (!filter.IsEmpty() && !filter.MayContain(entry.first)) {
+            continue;
+        }
+        std::vector<Field> fields = walker.GetFields(entry.second);
+        writer.Key(entry.first.c_str());
+        writer.StartObject();
+        // Inherited fields are listed under the base, by name
+        auto base = maps.find(maps[entry.second].baseMap);
+        if (base != maps.end()) {
+            writer.Key("base");
+            writer.String(base->second.name.c_str());
+        }
+        for (const Field& field : fields) {
+            if (!filter.IsEmpty() && !filter.Matches(entry.first + "." + field.name)) {
+                continue;
+            }
+            writer.Key(field.name.c_str());
+            writer.StartObject();
+            writer.Key("offset");
+            writer.Int(field.offset);
+            writer.Key("type");
+            writer.Int(field.type);
+            writer.Key("size");
+            writer.Int(field.size);
+            writer.EndObject();
+        }
+        writer.EndObject();
+    }
+    writer.EndObject();
+    return data.GetString();
+}
+
+void Tools::DumpDataMaps(Context& ctx, Formatter& fmt)
+{
+    std::string json = ScanDataMaps(ctx);
+    ScopedPhase phase(&ctx.GetStats(), "Print", "datamaps");
+    phase.AddBytes(json.size());
+    fmt.Print(json, "datamaps");
+}
@@ -0,0 +1,58 @@
+#include "tools.h"
+#include "../interfaces.h"
+#include "../scanner.h"
+#include "../stats.h"
+
+#include <map>
+#include <string>
+
+#include <rapidjson/prettywriter.h>
+#include <rapidjson/stringbuffer.h>
+
+std::string Tools::ScanInterfaces(Context& ctx)
+{
+    MemorySource& mem = ctx.GetMemory();
+    Scanner scanner(mem);
+    InterfaceRegistry registry;
+    {
+        ScopedPhase phase(&ctx.GetStats(), "Interfaces", "interfaces");
+        registry.Build(mem, scanner, ctx.GetPool());
+    }
+
+    std::map<std::string, const InterfaceRegistry::Module*> sorted;
+    for (const InterfaceRegistry::Module& module : registry.GetModules()) {
+        sorted.emplace(module.region->name, &module);
+    }
+
+    rapidjson::StringBuffer data;
+    rapidjson::PrettyWriter<rapidjson::StringBuffer> writer(data);
+    writer.StartObject();
+    for (const auto& it : sorted) {
+        const InterfaceRegistry::Module& module = *it.second;
+        writer.Key(it.first.c_str());
+        writer.StartObject();
+        for (const InterfaceRegistry::Interface& interface : module.interfaces) {
+            if (!ctx.GetFilter().Matches(interface.name.c_str())) {
+                continue;
+            }
+            writer.Key(interface.name.c_str());
+            writer.StartObject();
+            writer.Key("factory");
+            writer.Uint64(interface.factory);
+            writer.Key("offset");
+            writer.Uint64(interface.factory - module.region->start);
+            writer.EndObject();
+        }
+        writer.EndObject();
+    }
+    writer.EndObject();
+    return data.GetString();
+}
+
+void Tools::DumpInterfaces(Context& ctx, Formatter& fmt)
+{
+    std::string json = ScanInterfaces(ctx);
+    ScopedPhase phase(&ctx.GetStats(), "Print", "interfaces");
+    phase.AddBytes(json.size());
+    fmt.Print(json, "interfaces");
+}
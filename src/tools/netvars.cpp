@@ -1,16 +1,36 @@
 #include "tools.h"
-#include "../globals.h"
+#include "../elfmodule.h"
+#include "../logger.h"
+#include "../resolver.h"
+#include "../scanner.h"
+#include "../stats.h"
+
+#include <cstddef>
 
 #include <rapidjson/prettywriter.h>
 #include <rapidjson/stringbuffer.h>
 
+/**
+ * The data models the engine is built for.  The structures below take one
+ * as a template argument, so the same walker reads 64-bit and 32-bit
+ * targets; padding follows from natural alignment in both.
+ */
+struct LP64 {
+    typedef uint64_t Pointer;
+};
+
+struct ILP32 {
+    typedef uint32_t Pointer;
+};
+
+template<typename Abi>
 class ClientClass {
     public:
-        uintptr_t m_pCreateFn;
-        uintptr_t m_pCreateEventF;
-        uintptr_t m_pNetworkName;
-        uintptr_t m_pRecvTable;
-        uintptr_t m_pNext;
+        typename Abi::Pointer m_pCreateFn;
+        typename Abi::Pointer m_pCreateEventFn;
+        typename Abi::Pointer m_pNetworkName; // const char*
+        typename Abi::Pointer m_pRecvTable;
+        typename Abi::Pointer m_pNext;
         int m_ClassID;
 };
 
@@ -26,68 +46,110 @@ enum class SendPropType : int {
     DPT_NUMSendPropTypes
 };
 
+template<typename Abi>
 class RecvProp {
     public:
-        uintptr_t m_pVarName; // const char*
+        typename Abi::Pointer m_pVarName; // const char*
         SendPropType m_RecvType;
         int m_Flags;
         int m_StringBufferSize;
         bool m_bInsideArray;
-    private:
-        uint8_t pad0[3];
-    public:
-        uintptr_t m_pExtraData;
-        uintptr_t m_pArrayProp;
-        uintptr_t m_ArrayLengthProxy;
-        uintptr_t m_ProxyFn;
-        uintptr_t m_DataTableProxyFn;
-        uintptr_t m_pDataTable;
+        typename Abi::Pointer m_pExtraData;
+        typename Abi::Pointer m_pArrayProp;
+        typename Abi::Pointer m_ArrayLengthProxy;
+        typename Abi::Pointer m_ProxyFn;
+        typename Abi::Pointer m_DataTableProxyFn;
+        typename Abi::Pointer m_pDataTable;
         unsigned int m_Offset;
         int m_ElementStride;
         unsigned int m_nElements;
-    private:
-        uint8_t pad1[4];
-    public:
-        uintptr_t m_pParentArrayPropName;
+        typename Abi::Pointer m_pParentArrayPropName;
 };
 
+template<typename Abi>
 class RecvTable {
     public:
-        uintptr_t m_pProps;
+        typename Abi::Pointer m_pProps;
         unsigned int m_nProps;
-    private:
-        uint8_t pad0[4];
-    public:
-        uintptr_t m_pDecoder;
-        uintptr_t m_pNetTableName;
+        typename Abi::Pointer m_pDecoder;
+        typename Abi::Pointer m_pNetTableName; // const char*
         bool m_bInitialized;
 };
 
-static uintptr_t GetClassHead()
+static_assert(sizeof(ClientClass<LP64>) == 0x30, "ClientClass LP64 layout");
+static_assert(offsetof(ClientClass<LP64>, m_pNext) == 0x20, "ClientClass LP64 layout");
+static_assert(offsetof(ClientClass<LP64>, m_ClassID) == 0x28, "ClientClass LP64 layout");
+static_assert(sizeof(RecvProp<LP64>) == 0x60, "RecvProp LP64 layout");
+static_assert(offsetof(RecvProp<LP64>, m_pExtraData) == 0x18, "RecvProp LP64 layout");
+static_assert(offsetof(RecvProp<LP64>, m_pDataTable) == 0x40, "RecvProp LP64 layout");
+static_assert(offsetof(RecvProp<LP64>, m_Offset) == 0x48, "RecvProp LP64 layout");
+static_assert(offsetof(RecvProp<LP64>, m_pParentArrayPropName) == 0x58, "RecvProp LP64 layout");
+static_assert(sizeof(RecvTable<LP64>) == 0x28, "RecvTable LP64 layout");
+static_assert(offsetof(RecvTable<LP64>, m_pNetTableName) == 0x18, "RecvTable LP64 layout");
+
+static_assert(sizeof(ClientClass<ILP32>) == 0x18, "ClientClass ILP32 layout");
+static_assert(offsetof(ClientClass<ILP32>, m_pNext) == 0x10, "ClientClass ILP32 layout");
+static_assert(offsetof(ClientClass<ILP32>, m_ClassID) == 0x14, "ClientClass ILP32 layout");
+static_assert(sizeof(RecvProp<ILP32>) == 0x3c, "RecvProp ILP32 layout");
+static_assert(offsetof(RecvProp<ILP32>, m_pExtraData) == 0x14, "RecvProp ILP32 layout");
+static_assert(offsetof(RecvProp<ILP32>, m_pDataTable) == 0x28, "RecvProp ILP32 layout");
+static_assert(offsetof(RecvProp<ILP32>, m_Offset) == 0x2c, "RecvProp ILP32 layout");
+static_assert(offsetof(RecvProp<ILP32>, m_pParentArrayPropName) == 0x38, "RecvProp ILP32 layout");
+static_assert(sizeof(RecvTable<ILP32>) == 0x14, "RecvTable ILP32 layout");
+static_assert(offsetof(RecvTable<ILP32>, m_pNetTableName) == 0xc, "RecvTable ILP32 layout");
+
+/**
+ * Relative entries follow the rel32 target at the match, others take the
+ * absolute address stored there, e.g. mov eax, [abs32] in 32-bit code.
+ */
+static uintptr_t GetClassHead(Context& ctx, size_t pointerSize)
 {
-    libconfig::Setting& entry = g_cfg.lookup("signatures.dwGetAllClasses");
+    MemorySource& mem = ctx.GetMemory();
+    libconfig::Setting& entry = ctx.GetConfig().lookup("signatures.dwGetAllClasses");
     const char* region = entry.lookup("region");
     const char* pattern = entry.lookup("pattern");
     libconfig::Setting& offset = entry.lookup("offset");
-    uintptr_t addr = g_process.FindPattern(region, pattern, offset[0]);
-    addr = g_process.GetCallAddress(addr);
+    Scanner scanner(mem);
+    uintptr_t addr;
+    {
+        ScopedPhase phase(&ctx.GetStats(), "FindPattern", "dwGetAllClasses");
+        addr = scanner.FindPattern(region, pattern, offset[0]);
+    }
+    ScopedPhase phase(&ctx.GetStats(), "PointerChain", "dwGetAllClasses");
+    std::vector<int> hops;
     for (int i = 1; i < offset.getLength(); ++i) {
-        addr = g_process.Read<uintptr_t>(addr + static_cast<int>(offset[i]));
+        hops.push_back(offset[i]);
+    }
+    uintptr_t start = 0;
+    if (static_cast<int>(entry.lookup("relative"))) {
+        start = scanner.GetCallAddress(addr);
+    } else if (addr && !scanner.Read(addr, &start, pointerSize)) {
+        start = 0;
     }
-    return addr;
+    PointerResolver resolver(mem, pointerSize);
+    size_t chain = resolver.Add(start, hops);
+    resolver.Resolve();
+    return resolver.GetResult(chain);
 }
 
-static void DumpNetvarTable(RecvTable table, const char* tableName, int depth,
+/**
+ * scope is the dotted name the filter sees for this table, usually the
+ * output path.
+ */
+template<typename Abi>
+static void DumpNetvarTable(MemorySource& mem, const RecvTable<Abi>& table, const char* tableName,
+        const std::string& scope, const NameFilter& filter,
         rapidjson::PrettyWriter<rapidjson::StringBuffer>& writer)
 {
-    RecvProp props[1024];
+    RecvProp<Abi> props[1024];
     char propName[64];
-    if (g_process.ReadMemory(table.m_pProps, props, sizeof(RecvProp) * table.m_nProps) < 1) {
+    if (!table.m_nProps || table.m_nProps > sizeof(props) / sizeof(props[0])
+            || !mem.ReadChecked(table.m_pProps, props, sizeof(RecvProp<Abi>) * table.m_nProps)) {
         return;
     }
 
     // Skip empty classes
-    g_process.ReadMemory(props[0].m_pVarName, propName, sizeof(propName));
+    mem.ReadString(props[0].m_pVarName, propName, sizeof(propName));
     if (table.m_nProps == 1) {
         if (!strcmp(propName, "baseclass")) {
             return;
@@ -101,8 +163,8 @@ static void DumpNetvarTable(RecvTable table, const char* tableName, int depth,
     writer.Key(tableName);
     writer.StartObject();
     for (size_t i = 0; i < table.m_nProps; ++i) {
-        RecvProp& prop = props[i];
-        if (g_process.ReadMemory(prop.m_pVarName, propName, sizeof(propName)) < 1) {
+        RecvProp<Abi>& prop = props[i];
+        if (!mem.ReadString(prop.m_pVarName, propName, sizeof(propName))) {
             continue;
         }
 
@@ -114,18 +176,23 @@ static void DumpNetvarTable(RecvTable table, const char* tableName, int depth,
             continue;
         }
 
+        bool bWanted = filter.IsEmpty() || filter.Matches(scope + "." + propName);
         if (prop.m_RecvType == SendPropType::DPT_DataTable && prop.m_pDataTable) {
-            if (prop.m_Offset > 0) {
+            if (prop.m_Offset > 0 && bWanted) {
                 writer.Key(propName);
                 writer.Uint(prop.m_Offset);
             }
-            auto nextTable = g_process.Read<RecvTable>(prop.m_pDataTable);
+            RecvTable<Abi> nextTable;
             char nextTableName[64];
-            if (g_process.ReadMemory(nextTable.m_pNetTableName, nextTableName, sizeof(nextTableName)) < 1) {
+            if (!mem.ReadChecked(prop.m_pDataTable, nextTable)
+                    || !mem.ReadString(nextTable.m_pNetTableName, nextTableName, sizeof(nextTableName))) {
                 continue;
             }
-            DumpNetvarTable(nextTable, nextTableName, depth + 1, writer);
-        } else {
+            std::string nextScope = filter.IsEmpty() ? std::string() : scope + "." + nextTableName;
+            if (filter.IsEmpty() || filter.MayContain(nextScope)) {
+                DumpNetvarTable(mem, nextTable, nextTableName, nextScope, filter, writer);
+            }
+        } else if (bWanted) {
             writer.Key(propName);
             writer.Uint(prop.m_Offset);
         }
@@ -133,25 +200,75 @@ static void DumpNetvarTable(RecvTable table, const char* tableName, int depth,
     writer.EndObject();
 }
 
-void Tools::DumpNetvars(Formatter& fmt)
+template<typename Abi>
+static std::string WalkNetvars(Context& ctx, std::map<std::string, std::string>* tables)
 {
+    MemorySource& mem = ctx.GetMemory();
     rapidjson::StringBuffer data;
     rapidjson::PrettyWriter<rapidjson::StringBuffer> writer(data);
     writer.StartObject();
 
     char tableName[64];
-    ClientClass cc;
-    cc.m_pNext = GetClassHead();
-    do {
-        cc = g_process.Read<ClientClass>(cc.m_pNext);
-        if (cc.m_pRecvTable) {
-            auto table = g_process.Read<RecvTable>(cc.m_pRecvTable);
-            g_process.ReadMemory(cc.m_pNetworkName, tableName, sizeof(tableName));
-            DumpNetvarTable(table, tableName, 1, writer);
+    ClientClass<Abi> cc;
+    cc.m_pNext = GetClassHead(ctx, sizeof(typename Abi::Pointer));
+    Logger::Debug("ClientClass list at {:#x}", cc.m_pNext);
+    const NameFilter& filter = ctx.GetFilter();
+    ScopedPhase phase(&ctx.GetStats(), "NetvarWalk");
+    while (cc.m_pNext && mem.ReadChecked(cc.m_pNext, cc)) {
+        RecvTable<Abi> table;
+        if (!cc.m_pRecvTable || !mem.ReadString(cc.m_pNetworkName, tableName, sizeof(tableName))
+                || !mem.ReadChecked(cc.m_pRecvTable, table)) {
+            continue;
+        }
+
+        // Classes can be selected by their own name or by their table's,
+        // the output key is the class name either way
+        std::string scope;
+        if (!filter.IsEmpty()) {
+            scope = tableName;
+            if (!filter.MayContain(scope)) {
+                char netTableName[64];
+                if (!mem.ReadString(table.m_pNetTableName, netTableName, sizeof(netTableName))
+                        || !filter.MayContain(netTableName)) {
+                    continue;
+                }
+                scope = netTableName;
+            }
+        }
+        char netTableName[64];
+        if (tables && mem.ReadString(table.m_pNetTableName, netTableName, sizeof(netTableName))) {
+            (*tables)[tableName] = netTableName;
         }
-    } while (cc.m_pNext);
+        Logger::Trace("class {} id {} table {:#x}", tableName, cc.m_ClassID, cc.m_pRecvTable);
+        DumpNetvarTable(mem, table, tableName, scope, filter, writer);
+    }
     writer.EndObject();
+    return data.GetString();
+}
+
+/**
+ * Picks the walker for the data model of the module holding the class
+ * list, 64-bit unless it is a 32-bit ELF.  tables, if given, receives the
+ * RecvTable name of every class.
+ */
+std::string Tools::ScanNetvars(Context& ctx, std::map<std::string, std::string>* tables)
+{
+    MemorySource& mem = ctx.GetMemory();
+    const char* region = ctx.GetConfig().lookup("signatures.dwGetAllClasses.region");
+    const Region* module = mem.GetRegion(region);
+    ElfModule elf;
+    if (module && elf.Load(mem, module) && !elf.Is64()) {
+        Logger::Debug("{}: 32-bit module", module->name);
+        return WalkNetvars<ILP32>(ctx, tables);
+    }
+    return WalkNetvars<LP64>(ctx, tables);
+}
 
-    fmt.Print(data.GetString(), "netvars");
+void Tools::DumpNetvars(Context& ctx, Formatter& fmt)
+{
+    std::string json = ScanNetvars(ctx);
+    ScopedPhase phase(&ctx.GetStats(), "Print", "netvars");
+    phase.AddBytes(json.size());
+    fmt.Print(json, "netvars");
 }
 
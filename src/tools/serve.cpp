@@ -0,0 +1,12 @@
+#include "tools.h"
+#include "../server.h"
+
+bool Tools::Serve(Context& ctx, const char* socketPath)
+{
+    Server server(ctx);
+    if (!server.Reload() || !server.Listen(socketPath)) {
+        return false;
+    }
+    server.Run();
+    return true;
+}
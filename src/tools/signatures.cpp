@@ -1,42 +1,403 @@
 #include "tools.h"
-#include "../globals.h"
+#include "../elfmodule.h"
+#include "../logger.h"
+#include "../resolver.h"
+#include "../scanner.h"
+#include "../stats.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 #include <rapidjson/document.h>
 #include <rapidjson/prettywriter.h>
 #include <rapidjson/stringbuffer.h>
 
-void Tools::DumpSignatures(Formatter& fmt)
+namespace {
+
+/**
+ * One config entry.  Pattern entries scan their region, derived entries
+ * (base = "name") start from the value of their base and follow their own
+ * offset hops, xref entries (xref = "name") match the code in their region
+ * that references the value of their base and string entries (string =
+ * "text") the code that references that string.  A symbol (symbol = "name")
+ * found in the module's symbol tables replaces the match, and the scan, of
+ * any of them.  value is the absolute result
+ * including extra, origin is what gets subtracted on output (the module
+ * start for relative entries).
+ */
+struct Node {
+    const libconfig::Setting* entry;
+    const Region* region = nullptr;
+    const char* pattern = nullptr;
+    const char* text = nullptr;
+    const char* symbol = nullptr;
+    int patternOffset = 0;
+    int base = -1;
+    int depth = 0;
+    std::vector<int> hops;
+    int extra = 0;
+    int maxMismatches = 0;
+    int xrefIndex = 0;
+    int instruction = -1;
+    const char* operand = "";
+    bool bXref = false;
+    bool bSymbol = false;
+    bool bRelative = false;
+    bool bRequested = false;
+    bool bNeeded = false;
+    uintptr_t match = 0;
+    uintptr_t value = 0;
+    uintptr_t origin = 0;
+    size_t chain = SIZE_MAX;
+};
+
+}
+
+/**
+ * Depth of a node in the dependency graph, -1 if it sits on a cycle.
+ */
+static int GetDepth(std::vector<Node>& nodes, std::vector<int>& state, int index)
 {
-    rapidjson::StringBuffer data;
-    rapidjson::PrettyWriter<rapidjson::StringBuffer> writer(data);
-    writer.StartObject();
+    if (state[index] == 2) {
+        return nodes[index].depth;
+    }
+    if (state[index] == 1) {
+        return -1;
+    }
+    state[index] = 1;
+    int depth = 0;
+    if (nodes[index].base != -1) {
+        depth = GetDepth(nodes, state, nodes[index].base);
+        depth = depth < 0 ? -1 : depth + 1;
+    }
+    nodes[index].depth = depth;
+    state[index] = 2;
+    return depth;
+}
+
+/**
+ * Matches the xref_index-th of the referencing instructions, in address
+ * order.
+ */
+static void MatchReference(Node& node, std::vector<uintptr_t>& sources)
+{
+    std::sort(sources.begin(), sources.end());
+    if (node.xrefIndex >= 0 && static_cast<size_t>(node.xrefIndex) < sources.size()) {
+        node.match = sources[node.xrefIndex] + node.patternOffset;
+    } else {
+        Logger::Debug("{}: {} references", node.entry->getName(), sources.size());
+    }
+}
+
+/**
+ * Finds the instruction an xref node matches, one that references the
+ * address its base resolved to.
+ */
+static void ResolveXref(Context& ctx, Scanner& scanner, Node& node, const Node& base)
+{
+    if (!node.region || !base.value || !base.bRelative) {
+        if (base.value && !base.bRelative) {
+            Logger::Error("{}: xref needs a relative base", node.entry->getName());
+        }
+        return;
+    }
+    std::vector<uintptr_t> sources;
+    scanner.GetXrefs(node.region, ctx.GetPool()).GetSources(base.value, sources);
+    MatchReference(node, sources);
+}
+
+/**
+ * Finds the instruction a string node matches, one that loads the address
+ * of the string.
+ */
+static void ResolveString(Context& ctx, Scanner& scanner, Node& node)
+{
+    std::vector<uintptr_t> strings;
+    if (!scanner.GetStrings(node.region, ctx.GetPool()).Find(node.text, strings)) {
+        Logger::Debug("{}: no reference to \"{}\"", node.entry->getName(), node.text);
+        return;
+    }
+    const XrefIndex& xrefs = scanner.GetXrefs(node.region, ctx.GetPool());
+    std::vector<uintptr_t> sources;
+    for (uintptr_t address : strings) {
+        xrefs.GetSources(address, sources, XrefIndex::Kind_Data);
+    }
+    MatchReference(node, sources);
+}
+
+static ElfModule& GetModule(MemorySource& mem, std::unordered_map<const Region*, ElfModule>& modules,
+        const Region* region)
+{
+    auto it = modules.find(region);
+    if (it == modules.end()) {
+        it = modules.emplace(region, ElfModule()).first;
+        if (!it->second.Load(mem, region)) {
+            Logger::Debug("{}: not an ELF module", region->name);
+        }
+    }
+    return it->second;
+}
 
-    libconfig::Setting& signatures = g_cfg.lookup("signatures");
-    for (const libconfig::Setting& entry : signatures) {
-        const char *region = entry.lookup("region");
-        const char *pattern = entry.lookup("pattern");
-        int extra = entry.lookup("extra");
-        int relative = entry.lookup("relative");
-        libconfig::Setting& offset = entry.lookup("offset");
-
-        TuxProc::Region* currentRegion = g_process.GetRegion(region);
-        if (region) {
-            uintptr_t addr = g_process.FindPattern(currentRegion, pattern, offset[0]);
-            uintptr_t startAddr = 0;
-            if (relative) {
-                startAddr = currentRegion->GetStartAddress();
-                addr = g_process.GetCallAddress(addr);
-                for (int i = 1; i < offset.getLength(); ++i) {
-                    addr = g_process.Read<uintptr_t>(addr + static_cast<int>(offset[i]));
+/**
+ * A process is either all 32-bit or all 64-bit, so the first module an
+ * entry needs decides how wide the pointers in every chain are.
+ */
+static size_t GetPointerSize(MemorySource& mem, std::unordered_map<const Region*, ElfModule>& modules,
+        const std::vector<Node>& nodes)
+{
+    for (const Node& node : nodes) {
+        if (node.bNeeded && node.region) {
+            return GetModule(mem, modules, node.region).Is64() ? sizeof(uint64_t) : sizeof(uint32_t);
+        }
+    }
+    return sizeof(uintptr_t);
+}
+
+/**
+ * Looks the node's symbol up in .dynsym, then in the .symtab of the module
+ * file.  A hit is the address the node's pattern would have led to.
+ */
+static bool ResolveSymbol(MemorySource& mem, std::unordered_map<const Region*, ElfModule>& modules, Node& node)
+{
+    if (!node.symbol || !node.region) {
+        return false;
+    }
+    ElfModule& elf = GetModule(mem, modules, node.region);
+    node.match = elf.FindSymbol(node.symbol);
+    if (!node.match) {
+        node.match = elf.FindStaticSymbol(node.symbol);
+    }
+    node.bSymbol = node.match != 0;
+    if (!node.bSymbol) {
+        Logger::Debug("{}: symbol {} not found in {}", node.entry->getName(), node.symbol, node.region->name);
+    }
+    return node.bSymbol;
+}
+
+/**
+ * Starts resolving a node through the instruction-th instruction after its
+ * match: relative entries follow its branch or RIP-relative target, others
+ * take its displacement or immediate.
+ */
+static void StartDecoded(Node& node, Scanner& scanner, PointerResolver& resolver)
+{
+    Instruction insn;
+    uintptr_t address = scanner.Decode(node.match, node.instruction, insn);
+    if (node.match && !address) {
+        Logger::Debug("{}: no instruction {} at {:#x}", node.entry->getName(), node.instruction, node.match);
+    }
+    if (node.bRelative) {
+        node.origin = node.region->GetStartAddress();
+        node.chain = resolver.Add(address ? insn.GetTarget(address) : 0, node.hops);
+    } else if (address) {
+        bool bImmediate = !strcmp(node.operand, "imm") || (!*node.operand && !insn.dispSize);
+        int64_t value = bImmediate ? insn.immediate : insn.displacement;
+        node.value = value ? value + node.extra : 0;
+    }
+}
+
+/**
+ * Starts resolving a matched node: relative entries follow the call or
+ * RIP-relative target at the match, others read the value at the match.
+ */
+static void StartNode(Node& node, Scanner& scanner, PointerResolver& resolver)
+{
+    if (node.bSymbol && node.bRelative) {
+        node.origin = node.region->GetStartAddress();
+        node.chain = resolver.Add(node.match, node.hops);
+    } else if (node.instruction >= 0 && !node.bSymbol) {
+        StartDecoded(node, scanner, resolver);
+    } else if (node.bRelative) {
+        node.origin = node.region->GetStartAddress();
+        node.chain = resolver.Add(scanner.GetCallAddress(node.match), node.hops);
+    } else if (node.match) {
+        int value = 0;
+        scanner.Read(node.match, &value, sizeof(value));
+        node.value = value ? value + node.extra : 0;
+    }
+}
+
+std::string Tools::ScanSignatures(Context& ctx)
+{
+    MemorySource& mem = ctx.GetMemory();
+    libconfig::Setting& signatures = ctx.GetConfig().lookup("signatures");
+
+    // Build the graph
+    std::vector<Node> nodes(signatures.getLength());
+    std::unordered_map<std::string, int> lookup;
+    for (int i = 0; i < signatures.getLength(); ++i) {
+        lookup[signatures[i].getName()] = i;
+    }
+    for (int i = 0; i < signatures.getLength(); ++i) {
+        const libconfig::Setting& entry = signatures[i];
+        Node& node = nodes[i];
+        node.entry = &entry;
+        entry.lookupValue("extra", node.extra);
+        entry.lookupValue("max_mismatches", node.maxMismatches);
+        int first = 0;
+        if (entry.exists("base")) {
+            node.base = lookup[static_cast<const char*>(entry.lookup("base"))];
+        } else {
+            const char* region = entry.lookup("region");
+            entry.lookupValue("xref_index", node.xrefIndex);
+            entry.lookupValue("instruction", node.instruction);
+            entry.lookupValue("operand", node.operand);
+            entry.lookupValue("symbol", node.symbol);
+            if (entry.exists("xref")) {
+                node.base = lookup[static_cast<const char*>(entry.lookup("xref"))];
+                node.bXref = true;
+            } else if (entry.exists("string")) {
+                node.text = entry.lookup("string");
+            } else if (entry.exists("pattern")) {
+                node.pattern = entry.lookup("pattern");
+            }
+            node.bRelative = static_cast<int>(entry.lookup("relative"));
+            node.patternOffset = entry.lookup("offset")[0];
+            node.region = mem.GetRegion(region);
+            if (!node.region) {
+                Logger::Debug("{}: region {} not found", entry.getName(), region);
+            }
+            first = 1;
+        }
+        if (entry.exists("offset")) {
+            const libconfig::Setting& offset = entry.lookup("offset");
+            for (int j = first; j < offset.getLength(); ++j) {
+                node.hops.push_back(offset[j]);
+            }
+        }
+    }
+
+    // Everything requested pulls in its bases
+    const NameFilter& filter = ctx.GetFilter();
+    std::vector<int> state(nodes.size(), 0);
+    int maxDepth = 0;
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        int depth = GetDepth(nodes, state, i);
+        if (depth < 0) {
+            Logger::Error("{}: circular base", nodes[i].entry->getName());
+            continue;
+        }
+        if (!filter.Matches(nodes[i].entry->getName())) {
+            continue;
+        }
+        nodes[i].bRequested = true;
+        maxDepth = std::max(maxDepth, depth);
+        for (int at = i; at != -1 && !nodes[at].bNeeded; at = nodes[at].base) {
+            nodes[at].bNeeded = true;
+        }
+    }
+
+    // Depth 0: symbols first, then scan every pattern still needed in parallel
+    Scanner scanner(mem);
+    std::unordered_map<const Region*, ElfModule> modules;
+    std::vector<Node*> scans;
+    std::vector<Node*> strings;
+    std::vector<Node*> symbols;
+    {
+        ScopedPhase phase(&ctx.GetStats(), "FindSymbol", "signatures");
+        for (Node& node : nodes) {
+            if (!node.bNeeded || node.depth != 0 || !node.region) {
+                continue;
+            }
+            if (ResolveSymbol(mem, modules, node)) {
+                symbols.push_back(&node);
+            } else if (node.text) {
+                strings.push_back(&node);
+            } else if (node.pattern) {
+                scans.push_back(&node);
+            }
+        }
+    }
+    ctx.GetPool().ParallelFor(scans.size(), [&](size_t i) {
+        Node& node = *scans[i];
+        ScopedPhase phase(&ctx.GetStats(), "FindPattern", node.entry->getName());
+        const char* name = node.entry->getName();
+        uint64_t hint;
+        uintptr_t hintAddress = ctx.GetHints().Get(name, hint) ? node.region->start + hint : 0;
+        node.match = scanner.FindPattern(node.region, node.pattern, node.patternOffset, hintAddress);
+        if (!node.match && node.maxMismatches > 0) {
+            size_t mismatches;
+            node.match = scanner.FindPatternApprox(node.region, node.pattern, node.patternOffset,
+                    node.maxMismatches, mismatches);
+            if (node.match) {
+                Logger::Warn("{}: matched with {} mismatching bytes, the pattern needs updating",
+                        name, mismatches);
+            }
+        }
+        if (node.match) {
+            ctx.GetHints().Set(name, node.match - node.patternOffset - node.region->start);
+        }
+    });
+
+    // String anchors are index lookups, the indexes build in parallel
+    for (Node* node : strings) {
+        ScopedPhase phase(&ctx.GetStats(), "FindString", node->entry->getName());
+        ResolveString(ctx, scanner, *node);
+        scans.push_back(node);
+    }
+    scans.insert(scans.end(), symbols.begin(), symbols.end());
+
+    PointerResolver resolver(mem, GetPointerSize(mem, modules, nodes));
+    ScopedPhase chainPhase(&ctx.GetStats(), "PointerChain", "signatures");
+    for (Node* node : scans) {
+        StartNode(*node, scanner, resolver);
+    }
+
+    // Resolve level by level, each level feeds the bases of the next
+    for (int depth = 0; depth <= maxDepth; ++depth) {
+        resolver.Resolve();
+        for (Node& node : nodes) {
+            if (node.depth == depth && node.chain != SIZE_MAX) {
+                uintptr_t addr = resolver.GetResult(node.chain);
+                node.value = addr ? addr + node.extra : 0;
+            }
+        }
+        for (Node& node : nodes) {
+            if (!node.bNeeded || node.depth != depth + 1) {
+                continue;
+            }
+            const Node& base = nodes[node.base];
+            if (node.bXref) {
+                if (!ResolveSymbol(mem, modules, node)) {
+                    ResolveXref(ctx, scanner, node, base);
                 }
-            } else {
-                addr = g_process.Read<int>(addr);
+                StartNode(node, scanner, resolver);
+                continue;
+            }
+            node.origin = base.origin;
+            node.bRelative = base.bRelative;
+            if (base.value) {
+                node.chain = resolver.Add(base.value, node.hops);
             }
-            writer.Key(entry.getName());
-            writer.Uint(addr ? addr + extra - startAddr : 0);
         }
     }
+
+    chainPhase.Stop();
+
+    rapidjson::StringBuffer data;
+    rapidjson::PrettyWriter<rapidjson::StringBuffer> writer(data);
+    writer.StartObject();
+    for (const Node& node : nodes) {
+        if (!node.bRequested || (node.depth == 0 && !node.region)) {
+            continue;
+        }
+        Logger::Trace("{}: match {:#x} value {:#x}", node.entry->getName(), node.match,
+                node.value ? node.value - node.origin : 0);
+        writer.Key(node.entry->getName());
+        writer.Uint(node.value ? node.value - node.origin : 0);
+    }
     writer.EndObject();
-    fmt.Print(data.GetString(), "signatures");
+    return data.GetString();
 }
 
+void Tools::DumpSignatures(Context& ctx, Formatter& fmt)
+{
+    std::string json = ScanSignatures(ctx);
+    ScopedPhase phase(&ctx.GetStats(), "Print", "signatures");
+    phase.AddBytes(json.size());
+    fmt.Print(json, "signatures");
+}
@@ -0,0 +1,55 @@
+#include "tools.h"
+#include "../logger.h"
+#include "../memory/snapshot.h"
+
+#include <set>
+
+bool Tools::Snapshot(Context& ctx, const char* path)
+{
+    // Run both dumps once to learn which heap pages they depend on
+    MemorySource& mem = ctx.GetMemory();
+    RecordingSource recorder(mem);
+    ctx.SetMemory(&recorder);
+    ScanSignatures(ctx);
+    ScanNetvars(ctx);
+    ctx.SetMemory(&mem);
+
+    std::set<std::string> modules;
+    for (const libconfig::Setting& entry : ctx.GetConfig().lookup("signatures")) {
+        if (entry.exists("region")) {
+            modules.insert(static_cast<const char*>(entry.lookup("region")));
+        }
+    }
+
+    std::vector<Region> regions;
+    for (const Region& region : mem.GetRegions()) {
+        if (modules.count(region.name)) {
+            regions.push_back(region);
+        }
+    }
+
+    size_t heapPages = 0;
+    for (uintptr_t page : recorder.GetPages()) {
+        const Region* owner = mem.FindRegion(page);
+        if (!owner || modules.count(owner->name)) {
+            continue;
+        }
+        heapPages++;
+        if (!regions.empty() && regions.back().end == page && regions.back().path == owner->path) {
+            regions.back().end += SNAPSHOT_PAGE_SIZE;
+            continue;
+        }
+        Region region = *owner;
+        region.offset += page - owner->start;
+        region.start = page;
+        region.end = page + SNAPSHOT_PAGE_SIZE;
+        regions.push_back(region);
+    }
+
+    if (!WriteSnapshot(mem, regions, path)) {
+        Logger::Error("Failed to write snapshot \"{}\"", path);
+        return false;
+    }
+    Logger::Log("Wrote {} regions ({} heap pages) to \"{}\"", regions.size(), heapPages, path);
+    return true;
+}
@@ -1,10 +1,26 @@
 #ifndef  __TUXDUMP_TOOLS_H__
 #define  __TUXDUMP_TOOLS_H__
+#include "../context.h"
 #include "../formatter.h"
 
+#include <map>
+#include <string>
+
 namespace Tools {
-    void DumpNetvars(Formatter& fmt);
-    void DumpSignatures(Formatter& fmt);
+    void DumpClasses(Context& ctx, Formatter& fmt);
+    void DumpConvars(Context& ctx, Formatter& fmt);
+    void DumpDataMaps(Context& ctx, Formatter& fmt);
+    void DumpInterfaces(Context& ctx, Formatter& fmt);
+    void DumpNetvars(Context& ctx, Formatter& fmt);
+    void DumpSignatures(Context& ctx, Formatter& fmt);
+    std::string ScanClasses(Context& ctx);
+    std::string ScanConvars(Context& ctx);
+    std::string ScanDataMaps(Context& ctx);
+    std::string ScanInterfaces(Context& ctx);
+    std::string ScanNetvars(Context& ctx, std::map<std::string, std::string>* tables = nullptr);
+    std::string ScanSignatures(Context& ctx);
+    bool Serve(Context& ctx, const char* socketPath);
+    bool Snapshot(Context& ctx, const char* path);
 }
 
 #endif //__TUXDUMP_TOOLS_H__
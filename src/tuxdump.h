@@ -0,0 +1,25 @@
+#ifndef  __TUXDUMP_TUXDUMP_H__
+#define  __TUXDUMP_TUXDUMP_H__
+
+/**
+ * Public interface of libtuxdump.  Create a Context, point it at a memory
+ * source, load a signature config and call the tools:
+ *
+ *     ProcessSource process;
+ *     process.Attach("csgo_linux64") && process.ParseMaps();
+ *     Context ctx;
+ *     ctx.SetMemory(&process);
+ *     ctx.LoadConfig("csgo.cfg");
+ *     std::string json = Tools::ScanNetvars(ctx);
+ */
+#include "context.h"
+#include "formatter.h"
+#include "scanner.h"
+#include "stats.h"
+#include "memory/core.h"
+#include "memory/process.h"
+#include "memory/snapshot.h"
+#include "memory/synthetic.h"
+#include "tools/tools.h"
+
+#endif //__TUXDUMP_TUXDUMP_H__
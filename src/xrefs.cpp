@@ -0,0 +1,157 @@
+#include "xrefs.h"
+#include "decoder.h"
+
+#include <algorithm>
+#include <sys/mman.h>
+
+static const size_t CHUNK_SIZE = 1 << 20;
+static const size_t MAX_STRING = 256;
+
+// Decoding starts this far before a chunk so it is back in sync with the
+// instruction stream by the time it reaches the chunk
+static const size_t CHUNK_LEAD = 64;
+
+namespace {
+
+struct Chunk {
+    size_t regionBegin;
+    size_t regionEnd;
+    size_t begin;
+    size_t end;
+    std::vector<XrefIndex::Xref> xrefs;
+};
+
+}
+
+static void DecodeChunk(const uint8_t* image, size_t imageSize, Chunk& chunk)
+{
+    size_t pos = chunk.begin - std::min(chunk.begin - chunk.regionBegin, CHUNK_LEAD);
+    Instruction insn;
+    while (pos < chunk.end) {
+        if (!insn.Decode(image + pos, chunk.regionEnd - pos)) {
+            pos++;
+            continue;
+        }
+        if (pos >= chunk.begin && (insn.bRipRelative || insn.bBranch)) {
+            XrefIndex::Kind kind = insn.bRipRelative ? XrefIndex::Kind_Data
+                    : insn.IsCall() ? XrefIndex::Kind_Call
+                    : insn.IsJump() ? XrefIndex::Kind_Jump : XrefIndex::Kind_Any;
+            uintptr_t target = insn.GetTarget(pos);
+            if (kind != XrefIndex::Kind_Any && target < imageSize) {
+                chunk.xrefs.push_back({static_cast<uint32_t>(target), static_cast<uint32_t>(pos), kind});
+            }
+        }
+        pos += insn.length;
+    }
+}
+
+void XrefIndex::Build(const MemorySource& mem, const Region* module, const uint8_t* image, ThreadPool& pool)
+{
+    m_base = module->start;
+    m_xrefs.clear();
+
+    // Fixed-size chunks, so the result does not depend on the thread count
+    std::vector<Chunk> chunks;
+    for (const Region& region : mem.GetRegions()) {
+        if (region.start < module->start || region.end > module->end || !(region.perms & PROT_EXEC)
+                || !(region.perms & PROT_READ)) {
+            continue;
+        }
+        size_t regionBegin = region.start - module->start;
+        size_t regionEnd = region.end - module->start;
+        for (size_t begin = regionBegin; begin < regionEnd; begin += CHUNK_SIZE) {
+            Chunk chunk;
+            chunk.regionBegin = regionBegin;
+            chunk.regionEnd = regionEnd;
+            chunk.begin = begin;
+            chunk.end = std::min(begin + CHUNK_SIZE, regionEnd);
+            chunks.push_back(chunk);
+        }
+    }
+
+    size_t imageSize = module->GetSize();
+    pool.ParallelFor(chunks.size(), [&](size_t i) {
+        DecodeChunk(image, imageSize, chunks[i]);
+    });
+
+    size_t total = 0;
+    for (const Chunk& chunk : chunks) {
+        total += chunk.xrefs.size();
+    }
+    m_xrefs.reserve(total);
+    for (const Chunk& chunk : chunks) {
+        m_xrefs.insert(m_xrefs.end(), chunk.xrefs.begin(), chunk.xrefs.end());
+    }
+    std::sort(m_xrefs.begin(), m_xrefs.end(), [](const Xref& a, const Xref& b) {
+        return a.target != b.target ? a.target < b.target : a.source < b.source;
+    });
+}
+
+size_t XrefIndex::GetSources(uintptr_t target, std::vector<uintptr_t>& sources, int kinds) const
+{
+    if (target < m_base || target - m_base > UINT32_MAX) {
+        return 0;
+    }
+    uint32_t offset = target - m_base;
+    auto it = std::lower_bound(m_xrefs.begin(), m_xrefs.end(), offset, [](const Xref& xref, uint32_t value) {
+        return xref.target < value;
+    });
+    size_t count = 0;
+    for (; it != m_xrefs.end() && it->target == offset; ++it) {
+        if (it->kind & kinds) {
+            sources.push_back(m_base + it->source);
+            count++;
+        }
+    }
+    return count;
+}
+
+/**
+ * Length of the C string at data, 0 unless it is text terminated within
+ * size bytes.
+ */
+static size_t GetStringLength(const uint8_t* data, size_t size)
+{
+    size = std::min(size, MAX_STRING);
+    for (size_t i = 0; i < size; ++i) {
+        uint8_t c = data[i];
+        if (!c) {
+            return i;
+        }
+        if (c < 0x20 && c != '\t' && c != '\n' && c != '\r') {
+            return 0;
+        }
+    }
+    return 0;
+}
+
+void StringIndex::Build(const Region* module, const uint8_t* image, const XrefIndex& xrefs)
+{
+    m_base = module->start;
+    m_strings.clear();
+    size_t imageSize = module->GetSize();
+    uint32_t last = UINT32_MAX;
+    for (const XrefIndex::Xref& xref : xrefs.GetXrefs()) {
+        if (xref.kind != XrefIndex::Kind_Data || xref.target == last) {
+            continue;
+        }
+        last = xref.target;
+        size_t length = GetStringLength(image + xref.target, imageSize - xref.target);
+        if (length) {
+            m_strings[std::string(reinterpret_cast<const char*>(image + xref.target), length)]
+                    .push_back(xref.target);
+        }
+    }
+}
+
+size_t StringIndex::Find(const std::string& text, std::vector<uintptr_t>& addresses) const
+{
+    auto it = m_strings.find(text);
+    if (it == m_strings.end()) {
+        return 0;
+    }
+    for (uint32_t offset : it->second) {
+        addresses.push_back(m_base + offset);
+    }
+    return it->second.size();
+}
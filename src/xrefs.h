@@ -0,0 +1,55 @@
+#ifndef  __TUXDUMP_XREFS_H__
+#define  __TUXDUMP_XREFS_H__
+#include "memory/source.h"
+#include "threadpool.h"
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Every rel32 call, rel32 jump and RIP-relative operand in the executable
+ * mappings of a module, sorted by target.  Built once with a linear sweep
+ * of the length decoder, in parallel over fixed-size chunks.  Addresses
+ * are stored relative to the module, targets outside it are dropped.
+ */
+class XrefIndex {
+    public:
+        enum Kind : uint8_t {
+            Kind_Call = 1,
+            Kind_Jump = 2,
+            Kind_Data = 4,
+            Kind_Any = 7
+        };
+        struct Xref {
+            uint32_t target;
+            uint32_t source;
+            Kind kind;
+        };
+    public:
+        void Build(const MemorySource& mem, const Region* module, const uint8_t* image, ThreadPool& pool);
+        size_t GetSize() const { return m_xrefs.size(); }
+        const std::vector<Xref>& GetXrefs() const { return m_xrefs; }
+        size_t GetSources(uintptr_t target, std::vector<uintptr_t>& sources, int kinds = Kind_Any) const;
+    private:
+        uintptr_t m_base = 0;
+        std::vector<Xref> m_xrefs;
+};
+
+/**
+ * The C strings code refers to: every RIP-relative target of a module that
+ * holds a NUL-terminated run of text, keyed by that text.  Strings merged
+ * into the tail of a longer one are found at the address code uses.
+ */
+class StringIndex {
+    public:
+        void Build(const Region* module, const uint8_t* image, const XrefIndex& xrefs);
+        size_t GetSize() const { return m_strings.size(); }
+        size_t Find(const std::string& text, std::vector<uintptr_t>& addresses) const;
+    private:
+        uintptr_t m_base = 0;
+        std::unordered_map<std::string, std::vector<uint32_t>> m_strings;
+};
+
+#endif //__TUXDUMP_XREFS_H__